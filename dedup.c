@@ -0,0 +1,156 @@
+//---------------------------------------------------------------------
+// Assignment : PA-04 Threads - UDP
+// Date       : 12/1/2025
+// Author     : Kyle Mirra      Akwasi Okyere
+// File Name  : dedup.c
+//---------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "wrappers.h"
+#include "dedup.h"
+
+//------------------
+
+static unsigned hashKey( const dedupCache *c , const struct sockaddr_in *client , unsigned orderID )
+{
+    unsigned h = 2166136261u ;                 // FNV-1a
+    unsigned k[3] = { client->sin_addr.s_addr , client->sin_port , orderID } ;
+    const unsigned char *b = (const unsigned char *) k ;
+
+    for ( size_t i = 0 ; i < sizeof(k) ; i++ )
+        h = ( h ^ b[i] ) * 16777619u ;
+    return h & ( c->numBuckets - 1 ) ;
+}
+
+/*--------------------------------------------------------------------
+   'capacity' entries and at least as many hash buckets (a power of 2)
+----------------------------------------------------------------------*/
+void dedupInit( dedupCache *c , unsigned capacity , dedupTime ttlMS )
+{
+    memset( (void *) c , 0 , sizeof( *c ) ) ;
+    c->capacity   = capacity ;
+    c->ttlMS      = ttlMS ;
+    c->numBuckets = 1 ;
+    while ( c->numBuckets < capacity )
+        c->numBuckets *= 2 ;
+
+    c->pool   = calloc( capacity , sizeof( dedupEntry ) ) ;
+    c->bucket = calloc( c->numBuckets , sizeof( dedupEntry * ) ) ;
+    if ( c->pool == NULL || c->bucket == NULL )
+        err_sys( "Failed to allocate the request cache" ) ;
+
+    for ( unsigned i = 0 ; i < capacity ; i++ ) {
+        c->pool[i].newer = c->free ;
+        c->free = &c->pool[i] ;
+    }
+}
+
+//------------------
+
+static void unhash( dedupCache *c , dedupEntry *e )
+{
+    dedupEntry **pp = &c->bucket[ hashKey( c , &e->client , e->orderID ) ] ;
+    while ( *pp != e )
+        pp = &(*pp)->hnext ;
+    *pp = e->hnext ;
+}
+
+//------------------
+
+static void unlinkDone( dedupCache *c , dedupEntry *e )
+{
+    if ( e->older )  e->older->newer = e->newer ;  else  c->oldest = e->newer ;
+    if ( e->newer )  e->newer->older = e->older ;  else  c->newest = e->older ;
+    e->older = e->newer = NULL ;
+}
+
+//------------------
+
+static void release( dedupCache *c , dedupEntry *e )
+{
+    unlinkDone( c , e ) ;
+    unhash( c , e ) ;
+    e->state = DEDUP_FREE ;
+    e->newer = c->free ;
+    c->free  = e ;
+}
+
+//------------------
+
+static void expire( dedupCache *c , dedupTime now )
+{
+    while ( c->oldest && c->oldest->expires <= now ) {
+        release( c , c->oldest ) ;
+        c->expired++ ;
+    }
+}
+
+/*--------------------------------------------------------------------
+   The entry of a client's order, or NULL if it is not known (or no
+   longer)
+----------------------------------------------------------------------*/
+dedupEntry *dedupFind( dedupCache *c , const struct sockaddr_in *client , unsigned orderID , dedupTime now )
+{
+    expire( c , now ) ;
+
+    for ( dedupEntry *e = c->bucket[ hashKey( c , client , orderID ) ] ; e ; e = e->hnext )
+        if ( e->orderID == orderID
+             && e->client.sin_addr.s_addr == client->sin_addr.s_addr
+             && e->client.sin_port == client->sin_port ) {
+            c->hits++ ;
+            return e ;
+        }
+    return NULL ;
+}
+
+/*--------------------------------------------------------------------
+   A new RUNNING entry, making room by dropping the oldest DONE one if
+   needed. NULL if every entry belongs to a running order.
+----------------------------------------------------------------------*/
+dedupEntry *dedupAdd( dedupCache *c , const struct sockaddr_in *client , unsigned orderID , dedupTime now )
+{
+    expire( c , now ) ;
+
+    if ( c->free == NULL ) {
+        if ( c->oldest == NULL ) {
+            c->full++ ;
+            return NULL ;
+        }
+        release( c , c->oldest ) ;
+        c->evicted++ ;
+    }
+
+    dedupEntry *e = c->free ;
+    c->free = e->newer ;
+
+    memset( (void *) e , 0 , sizeof( *e ) ) ;
+    e->client  = *client ;
+    e->orderID = orderID ;
+    e->state   = DEDUP_RUNNING ;
+
+    dedupEntry **head = &c->bucket[ hashKey( c , client , orderID ) ] ;
+    e->hnext = *head ;
+    *head    = e ;
+    return e ;
+}
+
+/*--------------------------------------------------------------------
+   The order is over: keep the entry for another 'ttlMS'. The caller
+   fills in the summary fields.
+----------------------------------------------------------------------*/
+void dedupDone( dedupCache *c , dedupEntry *e , dedupTime now )
+{
+    if ( e->state == DEDUP_DONE )
+        unlinkDone( c , e ) ;
+
+    e->state   = DEDUP_DONE ;
+    e->owner   = NULL ;
+    e->expires = now + c->ttlMS ;
+    e->older   = c->newest ;
+    e->newer   = NULL ;
+    if ( c->newest )  c->newest->newer = e ;  else  c->oldest = e ;
+    c->newest  = e ;
+}
@@ -0,0 +1,59 @@
+//---------------------------------------------------------------------
+// Assignment : PA-04 Threads - UDP
+// Date       : 12/1/2025
+// Author     : Kyle Mirra      Akwasi Okyere
+// File Name  : dedup.h
+//---------------------------------------------------------------------
+
+#ifndef  DEDUP_H
+#define  DEDUP_H
+
+#include <netinet/in.h>
+
+/*--------------------------------------------------------------------
+   Recent orders by (client address, client's order ID), so that a
+   re-sent REQUEST_MSG is recognized instead of started again.
+
+   An entry is RUNNING while its order is in progress. Once the order
+   is over it is DONE and keeps what the order's SUMMARY_MSG needs; DONE
+   entries are kept in completion order and dropped after 'ttlMS', or
+   earlier, oldest first, when all 'capacity' entries are in use.
+   Entries live in one array allocated up front and are found through
+   a hash table, so lookups and updates are O(1) and never allocate.
+
+   Not thread-safe: the caller serializes access.
+----------------------------------------------------------------------*/
+typedef unsigned long long  dedupTime ;      // ms, any monotonic clock
+
+typedef enum { DEDUP_FREE , DEDUP_RUNNING , DEDUP_DONE } dedupState ;
+
+typedef struct dedupEntry {
+    struct sockaddr_in   client ;
+    unsigned             orderID ;
+    dedupState           state ;
+    void                *owner ;             // RUNNING: the order
+    int                  id , orderSize ,    // the server's order number, size,
+                         partsMade ;         // DONE: parts made
+    unsigned             duration ;          // DONE: how long it took (ms)
+    dedupTime            expires ;           // DONE: when it is dropped
+
+    struct dedupEntry   *hnext ,             // hash chain
+                        *older , *newer ;    // DONE entries by completion / free list
+} dedupEntry ;
+
+typedef struct {
+    unsigned        capacity , numBuckets ;
+    dedupTime       ttlMS ;
+    dedupEntry     *pool ,
+                  **bucket ,
+                   *free ,
+                   *oldest , *newest ;       // DONE entries
+    unsigned long   hits , expired , evicted , full ;
+} dedupCache ;
+
+void        dedupInit( dedupCache *c , unsigned capacity , dedupTime ttlMS ) ;
+dedupEntry *dedupFind( dedupCache *c , const struct sockaddr_in *client , unsigned orderID , dedupTime now ) ;
+dedupEntry *dedupAdd ( dedupCache *c , const struct sockaddr_in *client , unsigned orderID , dedupTime now ) ;
+void        dedupDone( dedupCache *c , dedupEntry *e , dedupTime now ) ;
+
+#endif
@@ -0,0 +1,120 @@
+//---------------------------------------------------------------------
+// Assignment : PA-04 Threads - UDP
+// Date       : 12/1/2025
+// Author     : Kyle Mirra      Akwasi Okyere
+// File Name  : factory-top.c
+//
+// Watch a running FACTORY server through its shared memory metrics,
+// without sending it anything or reading its output
+//---------------------------------------------------------------------
+
+#include <sys/types.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <signal.h>
+
+#include "wrappers.h"
+#include "metrics.h"
+
+/*--------------------------------------------------------------------
+   Print one snapshot: the header, then up to 'maxLines' sub-factories
+   and the totals over all of them
+----------------------------------------------------------------------*/
+void showSnapshot( const metricsBlock *m , unsigned short port , unsigned maxLines )
+{
+    metricsBlock        hdr ;
+    lineMetrics         l ;
+    unsigned            retries ;
+    unsigned long long  now = metricsClock() ;
+    unsigned long long  parts = 0 , iters = 0 , busy = 0 , idle = 0 ;
+    unsigned            running = 0 ;
+
+    retries = metricsReadHdr( m , &hdr ) ;
+
+    if ( hdr.pid == 0 )
+        printf( "FACTORY on port %hu: no server is updating the metrics (it has exited)\n" , port ) ;
+    else
+        printf( "FACTORY pid %d on port %hu , up %.1f s , %u sub-factories %s\n"
+                , (int) hdr.pid , port , ( now - hdr.startUs ) / 1e6 , hdr.numLines
+                , hdr.workers ? "on the timer wheel" : "as threads" ) ;
+    printf( "Active orders %u , served %llu , parts queued %llu , send errors %llu\n"
+            , hdr.activeOrders , hdr.ordersServed , hdr.queueDepth , hdr.sendErrors ) ;
+
+    printf( "\tSub-Factory\tParts Made\tIterations\tBusy (s)\tIdle (s)\tOrders\n" ) ;
+    for ( unsigned i = 0 ; i < hdr.numLines ; i++ )
+    {
+        retries += metricsReadLine( m , i , &l ) ;
+
+        // Add the time since the last change to where it belongs
+        unsigned long long since = now > l.sinceUs ? now - l.sinceUs : 0 ;
+        if ( l.running > 0 )
+            l.busyUs += since ;
+        else
+            l.idleUs += since ;
+
+        parts   += l.parts ;
+        iters   += l.iters ;
+        busy    += l.busyUs ;
+        idle    += l.idleUs ;
+        running += l.running ;
+
+        if ( i < maxLines )
+            printf( "\t\t%-3u\t\t%-8llu\t%-8llu\t%-8.1f\t%-8.1f\t%u\n"
+                    , i + 1 , l.parts , l.iters , l.busyUs / 1e6 , l.idleUs / 1e6 , l.running ) ;
+    }
+    if ( hdr.numLines > maxLines )
+        printf( "\t\t... %u more\n" , hdr.numLines - maxLines ) ;
+
+    printf( "\tTotal\t\t%-8llu\t%-8llu\t%-8.1f\t%-8.1f\t%u" , parts , iters , busy / 1e6 , idle / 1e6 , running ) ;
+    if ( busy + idle > 0 )
+        printf( "\t( %.0f%% busy )" , 100.0 * busy / ( busy + idle ) ) ;
+    printf( "\n" ) ;
+    if ( retries > 0 )
+        printf( "(%u reads retried while the server was writing)\n" , retries ) ;
+    printf( "\n" ) ;
+    fflush( stdout ) ;
+}
+
+/*-------------------------------------------------------*/
+int main( int argc , char *argv[] )
+{
+    unsigned short  port     = 50015 ;
+    long            interval = 1000 ;      // ms between snapshots
+    long            count    = 0 ;         // 0: until interrupted
+    unsigned        maxLines = 20 ;
+    int             opt ;
+
+    while ( ( opt = getopt( argc , argv , "i:n:l:" ) ) != -1 )
+    {
+        switch ( opt ) {
+          case 'i':
+            interval = atol( optarg ) ;
+            break ;
+          case 'n':
+            count = atol( optarg ) ;
+            break ;
+          case 'l':
+            maxLines = atoi( optarg ) ;
+            break ;
+          default:
+            printf( "FACTORY-TOP Usage: %s [-i intervalMS] [-n count] [-l maxLines] [port]\n" , argv[0] );
+            exit( 1 ) ;
+        }
+    }
+    if ( optind < argc )
+        port = atoi( argv[optind] ) ;
+
+    metricsBlock *m = metricsOpen( port ) ;
+
+    for ( long n = 0 ; count == 0 || n < count ; n++ )
+    {
+        if ( n > 0 )
+            Usleep( interval * 1000 ) ;
+        showSnapshot( m , port , maxLines ) ;
+    }
+
+    Shmdt( m ) ;
+    return 0 ;
+}
@@ -17,72 +17,208 @@
 #include <stdlib.h>
 #include <signal.h>
 #include <time.h>
+#include <poll.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
 #include <pthread.h>
 
 #include "wrappers.h"
 #include "message.h"
+#include "handoff.h"
+#include "wheel.h"
+#include "slab.h"
+#include "metrics.h"
+#include "dedup.h"
 
 #define MAXSTR     200
 #define IPSTRLEN    50
+#define PATHLEN    108
+
+#define HANDOFF_MAGIC    0x46414354   // "FACT"
+#define HANDOFF_VERSION  2
+
+#define ORDER_PREALLOC   4            // order slab blocks allocated at startup
+
+#define CLIENT_TIMEOUT_MS   5000      // stop an order whose client sent no keep-alive this long
+#define LIVENESS_CHECK_MS   500       // how often the main loop looks
+
+#define ORDER_CACHE_SIZE    4096      // orders remembered to recognize re-sent requests
+#define ORDER_CACHE_TTL_MS  60000     // ... for this long after they are over
 
 typedef struct sockaddr SA ;
 
+// One order being manufactured. Orders run side by side, each either on
+// its own supervisor thread and set of sub-factory threads, or as N
+// virtual lines on the timer wheel. An order and its per sub-factory
+// arrays share one block of 'orderPool', recycled when the order is done.
+typedef struct order {
+    int                 id ;              // server-local order number
+    struct sockaddr_in  client ;          // who placed it
+    unsigned            orderID ;         // the client's ID for it, or 0
+    struct dedupEntry  *cached ;          // its entry in 'recentOrders', or NULL
+    int                 sock ;            // UDP socket connected to 'client', or -1
+    int                 orderSize ,
+                        remainsToMake ;   // Must be protected by 'lock'
+    pthread_mutex_t     lock ;
+    struct timeval      startTime ;
+    unsigned            nextSeq ;         // sequence number of the next report
+    int                 linesLeft ;       // virtual lines still running
+    const char         *stopped ;         // why the order was stopped early, or NULL
+    int                 keepalive ;       // the client sends KEEPALIVE_MSG ...
+    tick_t              lastHeard ;       // ... last heard from it (ms, monotonic)
+    unsigned            sends ,           // datagrams sent to the client
+                        sendErrors ;      // ... that failed
+    unsigned long long  sendNs ;          // thread CPU time spent sending them
+    struct wheelLine   *lines ;           // virtual lines of this order
+    struct factoryResults *results ;      // results of its sub-factories
+    struct factoryArgs *args ;            // thread mode: sub-factory arguments
+    pthread_t          *tids ;            // ... and threads
+    struct order       *next ;            // in the list of active orders
+} order_t ;
+
 // Struct to hold the arguments to pass to each thread
-typedef struct {
+typedef struct factoryArgs {
     int facID;
     int capacity;
     int duration;
+    order_t *order;
 } factoryArgs;
 
-// Struct to hold the results from each thread 
-typedef struct {
+// Struct to hold the results from each thread
+typedef struct factoryResults {
     int facID;
     int totalParts;
     int iterations;
 } factoryResults;
 
+// A sub-factory in event-driven mode: a state machine on the timer wheel
+// instead of a thread. Each expiry reports the parts just made, claims
+// the next batch and re-arms the timer for the line's duration.
+typedef struct wheelLine {
+    wheelTimer      tmr ;          // must be first: fire() is given &tmr
+    factoryArgs     args ;
+    factoryResults *res ;
+    int             pending ;      // parts being made until the timer fires
+    tick_t          due ;          // ... which is then
+} wheelLine ;
+
+// What a running server hands to its replacement along with the socket
+typedef struct {
+    unsigned  magic , version ;
+    pid_t     pid ;                 // the server that is draining
+    unsigned  numOrders ;           // handoffOrder records that follow
+} handoffHdr ;
+
+// An order in progress, or (done) one in the request cache
+typedef struct {
+    struct sockaddr_in  client ;
+    unsigned            orderID ;
+    int                 id , orderSize , remainsToMake ,
+                        done , partsMade ;
+    unsigned            duration ;
+} handoffOrder ;
+
+// A datagram the new server passes on to the old one over their link
+typedef struct {
+    struct sockaddr_in  client ;
+    msgBuf              msg ;
+} forwardRec ;
+
 int minimum( int a , int b)
 {
-    return ( a <= b ? a : b ) ; 
+    return ( a <= b ? a : b ) ;
 }
 
-void subFactory( int factoryID , int myCapacity , int myDuration, factoryResults *res ) ;
+void subFactory( order_t *order , int factoryID , int myCapacity , int myDuration, factoryResults *res ) ;
 
 void *subFactoryThread(void *arg);
 
+void lineStep( wheelTimer *t ) ;
+void sendToClient( order_t *order , msgBuf *msg , const char *what ) ;
+
 void factLog( char *str )
 {
     printf( "%s" , str );
     fflush( stdout ) ;
 }
 
+// Stamp a message with its sequence number and the time it is sent
+void stampMsg( msgBuf *m , unsigned seqNum )
+{
+    struct timeval now ;
+
+    gettimeofday( &now , NULL ) ;
+    m->seqNum   = htonl( seqNum ) ;
+    m->sentSec  = htonl( (unsigned) now.tv_sec ) ;
+    m->sentUsec = htonl( (unsigned) now.tv_usec ) ;
+}
+
+unsigned long long threadCpuNs( void )
+{
+    struct timespec ts ;
+    clock_gettime( CLOCK_THREAD_CPUTIME_ID , &ts ) ;
+    return (unsigned long long) ts.tv_sec * 1000000000ull + ts.tv_nsec ;
+}
+
 /*-------------------------------------------------------*/
 
-// Global Variable for Future Thread to Shared
-int   remainsToMake , // Must be protected by a Mutex
-      actuallyMade ;  // Actually manufactured items
+int   N = 1 ;                  // Num threads serving each client
+int   numWorkers = 0 ;         // > 0: run sub-factories on the timer wheel
+wheelSched sched ;             // the wheel and its worker threads
 
+factoryArgs *lineSpec ;        // capacity & duration of each sub-factory, fixed at startup
+unsigned     advertisedCap ;   // parts per second the N sub-factories can make together
 
-int   numActiveFactories = 1 , orderSize ;
+// Active orders, shared by the main thread, the order supervisors and
+// the upgrade listener
+order_t        *activeOrders ;
+int             numActiveOrders , nextOrderID = 1 ;
+pthread_mutex_t orders_mutex = PTHREAD_MUTEX_INITIALIZER;
+slabPool        orderPool ;            // one block per order, see newOrder()
+dedupCache      recentOrders ;         // by client & order ID; partsMade < 0 in a
+                                       // DONE entry: still running in the old server
+size_t          offResults , offLines , offArgs , offTids ;
+int            *retiredSocks ;         // sockets of finished orders, closed by the main loop
+int             numRetired , maxRetired ;
 
-pthread_mutex_t remains_mutex = PTHREAD_MUTEX_INITIALIZER;
+metricsBlock   *metrics ;              // live counters for factory-top, or NULL
 
 int   sd ;      // Server socket descriptor
-struct sockaddr_in  
-             srvrSkt,       /* the address of this server   */
-             clntSkt;       /* remote client's socket       */
+int   legacySend ;  // -l: send everything with sendto() on 'sd'
+int   timeSends ;   // -t: measure the CPU time each datagram costs (two
+                    //     clock_gettime() system calls per datagram)
+struct sockaddr_in
+             srvrSkt;       /* the address of this server   */
+
+int   wakePipe[2] ;                   // wakes the main loop for signals / hand-off
+volatile sig_atomic_t stopSig ;       // signal that asked us to terminate
+volatile sig_atomic_t handedOff ;     // a replacement server owns the socket now
+char  upgradeSock[ PATHLEN ] ;        // where a replacement can take over
+volatile int successor = -1 ;         // link to our replacement, after a hand-off
+int   predecessor = -1 ;              // link to the server we took over from,
+                                      // while it drains its orders
 
 char  *myName = "Kyle Mirra and Akwasi Okyere" ;
 //------------------------------------------------------------
-//  Handle Ctrl-C or KILL 
+//  Handle Ctrl-C or KILL: let the main loop do the talking
 //------------------------------------------------------------
-void goodbye(int sig) 
+void goodbye(int sig)
+{
+    int saved = errno ;
+    stopSig = sig ;
+    write( wakePipe[1] , "s" , 1 ) ;
+    errno = saved ;
+}
+
+//------------------------------------------------------------
+//  Tell every client with an active order that we are leaving
+//------------------------------------------------------------
+void terminateServer(int sig)
 {
     fflush(stdout);
-           
+
     msgBuf byeMsg;
+    memset(&byeMsg, 0, sizeof(byeMsg));
     byeMsg.purpose = htonl(PROTOCOL_ERR);
     switch( sig ) {
         case SIGTERM:
@@ -90,205 +226,1018 @@ void goodbye(int sig)
             break ;
         case SIGINT:
             printf( "\n### I (%d) have been nicely asked to TERMINATE. "
-           "goodbye\n\n" , getpid() ); 
+           "goodbye\n\n" , getpid() );
             break ;
     }
 
-    if (sendto(sd, &byeMsg, sizeof(byeMsg), 0, (SA *) &clntSkt, sizeof(clntSkt)) < 0) {
-        err_sys("Error sending error message");
+    pthread_mutex_lock(&orders_mutex);
+    for (order_t *o = activeOrders; o != NULL; o = o->next) {
+        sendToClient(o, &byeMsg, "Error sending error message");
     }
-    pthread_mutex_destroy(&remains_mutex);
+    pthread_mutex_unlock(&orders_mutex);
+
+    if ( !handedOff )
+        unlink( upgradeSock ) ;
+    metricsRelease( metrics , ntohs( srvrSkt.sin_port ) , !handedOff ) ;
     close( sd ) ;
     exit( 0 ) ;
 }
 
+/*--------------------------------------------------------------------
+   Hot upgrade, old side: wait for a replacement server, give it the
+   bound socket plus the orders still in progress, and wake the main
+   loop so it stops reading requests and drains.
+----------------------------------------------------------------------*/
+void *upgradeListener( void *arg )
+{
+    int lsd = *(int *) arg ;
+    free( arg ) ;
+
+    while ( 1 )
+    {
+        int conn = handoffAccept( lsd ) ;
+        if ( conn < 0 ) {
+            perror( "Upgrade listener failed" ) ;
+            return NULL ;
+        }
+
+        // Snapshot the in-flight orders and the finished ones still cached
+        pthread_mutex_lock(&orders_mutex);
+        unsigned numRecs = numActiveOrders;
+        for (dedupEntry *e = recentOrders.oldest; e != NULL; e = e->newer) {
+            numRecs++;
+        }
+        size_t len = sizeof(handoffHdr) + numRecs * sizeof(handoffOrder);
+        handoffHdr *hdr = malloc(len);
+        if ( hdr == NULL ) {
+            pthread_mutex_unlock(&orders_mutex);
+            perror( "Upgrade snapshot failed" ) ;
+            close( conn ) ;
+            continue ;
+        }
+        hdr->magic     = HANDOFF_MAGIC ;
+        hdr->version   = HANDOFF_VERSION ;
+        hdr->pid       = getpid() ;
+        hdr->numOrders = numRecs ;
+
+        handoffOrder *rec = (handoffOrder *) (hdr + 1) ;
+        memset( rec , 0 , numRecs * sizeof(handoffOrder) ) ;
+        for (order_t *o = activeOrders; o != NULL; o = o->next, rec++) {
+            rec->client    = o->client ;
+            rec->orderID   = o->orderID ;
+            rec->id        = o->id ;
+            rec->orderSize = o->orderSize ;
+            pthread_mutex_lock(&o->lock);
+            rec->remainsToMake = o->remainsToMake ;
+            pthread_mutex_unlock(&o->lock);
+        }
+        for (dedupEntry *e = recentOrders.oldest; e != NULL; e = e->newer, rec++) {
+            rec->client    = e->client ;
+            rec->orderID   = e->orderID ;
+            rec->id        = e->id ;
+            rec->orderSize = e->orderSize ;
+            rec->done      = 1 ;
+            rec->partsMade = e->partsMade ;
+            rec->duration  = e->duration ;
+        }
+        pthread_mutex_unlock(&orders_mutex);
+
+        if ( handoffSend( conn , sd , hdr , len ) < 0 ) {
+            perror( "Handing the socket to the new server failed, still serving" ) ;
+            free( hdr ) ;
+            close( conn ) ;
+            continue ;
+        }
+        free( hdr ) ;
+
+        // The new server is reading the socket from now on
+        handedOff = 1 ;
+        unlink( upgradeSock ) ;
+        close( lsd ) ;
+
+        // Tell it the path is free, and keep the connection: it passes
+        // on what the clients of our orders send to the shared socket
+        char released = HANDOFF_RELEASED ;
+        if ( write( conn , &released , 1 ) == 1 )
+            successor = conn ;
+        else
+            close( conn ) ;
+        write( wakePipe[1] , "u" , 1 ) ;
+        return NULL ;
+    }
+}
+
+//------------------
+
+void startUpgradeListener( void )
+{
+    int *lsd = malloc( sizeof(int) ) ;
+    if ( lsd == NULL )
+        err_sys( "Couldn't allocate the upgrade listener" ) ;
+
+    if ( ( *lsd = handoffListen( upgradeSock ) ) < 0 ) {
+        perror( "Couldn't listen for hot upgrades" ) ;
+        free( lsd ) ;
+        return ;
+    }
+
+    pthread_t tid ;
+    Pthread_create( &tid , NULL , upgradeListener , lsd ) ;
+    Pthread_detach( tid ) ;
+    printf("Accepting hot upgrades on %s\n", upgradeSock);
+}
+
+/*--------------------------------------------------------------------
+   Hot upgrade, new side: take the bound socket from the running server
+----------------------------------------------------------------------*/
+void takeOver( unsigned short port )
+{
+    void   *state ;
+    size_t  len ;
+
+    if ( handoffReceive( upgradeSock , &sd , &state , &len , &predecessor ) < 0 )
+        err_sys( "Couldn't take over from the running FACTORY server" ) ;
+
+    handoffHdr *hdr = state ;
+    if ( len < sizeof(*hdr) || hdr->magic != HANDOFF_MAGIC || hdr->version != HANDOFF_VERSION
+         || len != sizeof(*hdr) + hdr->numOrders * sizeof(handoffOrder) )
+        err_quit( "Unexpected hand-off state from the running FACTORY server\n" ) ;
+
+    socklen_t alen = sizeof(srvrSkt);
+    if ( getsockname( sd , (SA *) &srvrSkt , &alen ) < 0 )
+        err_sys( "Inherited socket is not usable" ) ;
+    if ( ntohs( srvrSkt.sin_port ) != port )
+        printf( "Note: inherited socket is bound to port %d, not %hu\n"
+                , ntohs( srvrSkt.sin_port ) , port ) ;
+
+    printf( "Took over socket %d from FACTORY server pid %d\n" , sd , (int) hdr->pid ) ;
+
+    // Re-sent requests of the old server's orders are recognized here too
+    handoffOrder *rec = (handoffOrder *) (hdr + 1) ;
+    unsigned      numDone = 0 ;
+    for (unsigned i = 0; i < hdr->numOrders; i++, rec++) {
+        if ( rec->orderID != 0 ) {
+            dedupEntry *e = dedupAdd( &recentOrders , &rec->client , rec->orderID , wheelClock() ) ;
+            if ( e != NULL ) {
+                e->id        = rec->id ;
+                e->orderSize = rec->orderSize ;
+                e->partsMade = rec->done ? rec->partsMade : -1 ;
+                e->duration  = rec->duration ;
+                dedupDone( &recentOrders , e , wheelClock() ) ;
+            }
+        }
+        if ( rec->done ) {
+            numDone++ ;
+            continue ;
+        }
+
+        char clientIP[IPSTRLEN];
+        inet_ntop(AF_INET, (void *) &rec->client.sin_addr.s_addr, clientIP, IPSTRLEN);
+        printf( "\tOrder #%-4d from %s:%-5d size %-5d , %-5d parts not yet started\n"
+                , rec->id , clientIP , ntohs(rec->client.sin_port)
+                , rec->orderSize , rec->remainsToMake ) ;
+    }
+    printf( "It is draining %u order(s) and finished %u recently\n" , hdr->numOrders - numDone , numDone ) ;
+    free( state ) ;
+}
+
+/*--------------------------------------------------------------------
+   Print the summary of a finished order and retire it
+----------------------------------------------------------------------*/
+void finishOrder( order_t *order , factoryResults *results )
+{
+    // Variables to measure the time
+    struct timeval endTime;
+    double elapsedMS;
+
+    // get ending time and calculate total time
+    gettimeofday(&endTime, NULL);
+    elapsedMS = (endTime.tv_sec - order->startTime.tv_sec) * 1000.0 +
+        (endTime.tv_usec - order->startTime.tv_usec) / 1000.0;
+
+    printf("\n****** FACTORY Server (by %s ) Summary Report of Order #%d ******\n", myName, order->id);
+    if (order->stopped) {
+        printf("\tThe order was stopped early: %s\n", order->stopped);
+    }
+    printf("\tSub-Factory\tParts Made\tIterations\n");
+
+    // Go through the results array to find the total parts made and iterations of each thread
+    int totalMade = 0;
+    for (int i = 0; i < N; i++) {
+        printf("\t\t%-3d\t\t%-5d\t\t%-3d\n", results[i].facID, results[i].totalParts, results[i].iterations);
+        totalMade += results[i].totalParts;
+    }
+
+    // Print final results
+    printf("======================================================\n");
+    printf("Grand total parts made  =   %-5d vs order size %-5d\n", totalMade, order->orderSize);
+    printf("Order-to-Completion time =  %.1f milliSeconds\n", elapsedMS);
+
+    // Tell the client how it ended, which is all it gets if stopped early
+    msgBuf sumMsg;
+    memset(&sumMsg, 0, sizeof(sumMsg));
+    sumMsg.purpose   = htonl(SUMMARY_MSG);
+    sumMsg.orderSize = htonl(order->orderSize);
+    sumMsg.partsMade = htonl(totalMade);
+    sumMsg.numFac    = htonl(N);
+    sumMsg.duration  = htonl((unsigned) elapsedMS);
+    stampMsg(&sumMsg, __atomic_fetch_add(&order->nextSeq, 1, __ATOMIC_RELAXED));
+    sendToClient(order, &sumMsg, "Error sending the order summary");
+
+    if (order->sends > 0 && timeSends) {
+        printf("Reports sent            =   %-5u ( %u failed ) , %.2f uSec CPU per datagram on %s\n"
+               , order->sends, order->sendErrors, order->sendNs / 1000.0 / order->sends
+               , order->sock >= 0 ? "a connected socket" : "the shared socket");
+    }
+    else if (order->sends > 0) {
+        printf("Reports sent            =   %-5u ( %u failed ) on %s\n"
+               , order->sends, order->sendErrors
+               , order->sock >= 0 ? "a connected socket" : "the shared socket");
+    }
+
+    // Retire the order. Its socket may be in the main loop's poll set,
+    // so the main loop closes it.
+    pthread_mutex_lock(&orders_mutex);
+    for (order_t **pp = &activeOrders; *pp != NULL; pp = &(*pp)->next) {
+        if (*pp == order) {
+            *pp = order->next;
+            break;
+        }
+    }
+    numActiveOrders--;
+    metricsOrders(metrics, -1, 1, 0);
+    if (order->cached != NULL) {
+        order->cached->partsMade = totalMade;
+        order->cached->duration  = (unsigned) elapsedMS;
+        dedupDone(&recentOrders, order->cached, wheelClock());
+    }
+    if (order->sock >= 0) {
+        if (numRetired == maxRetired) {
+            maxRetired   = maxRetired ? 2 * maxRetired : 16;
+            retiredSocks = realloc(retiredSocks, maxRetired * sizeof(int));
+            if (retiredSocks == NULL) {
+                err_sys("Couldn't grow the list of retired sockets");
+            }
+        }
+        retiredSocks[numRetired++] = order->sock;
+    }
+    pthread_mutex_unlock(&orders_mutex);
+    write(wakePipe[1], "r", 1);
+
+    printf("Order memory            =   %zu-byte slab block , %lu orders served with %lu heap allocation(s)\n"
+           , orderPool.blockSize, orderPool.gets, orderPool.heapAllocs);
+
+    pthread_mutex_destroy(&order->lock);
+    slabPut(&orderPool, order);
+}
+
+/*--------------------------------------------------------------------
+   Order supervisor: run the N sub-factories of one order, wait for
+   them and print the order's summary
+----------------------------------------------------------------------*/
+void *orderThread( void *arg )
+{
+    order_t *order = arg ;
+
+    gettimeofday(&order->startTime, NULL); // Get start time
+
+    //Create N threads
+    for (int i = 0; i < N; i++) {
+        // Set the argument struct for the thread
+        factoryArgs *args = &order->args[i];
+        *args = lineSpec[i];
+        args->order = order;
+
+        pthread_create(&order->tids[i], NULL, subFactoryThread, args);
+        printf("Created Factory Thread #%-3d with capacity = %-4d parts and duration = %-5d mSecs\n",
+            args->facID, args->capacity, args->duration);
+    }
+
+    // Wait for all factories to finish; they leave their results in the order
+    for (int i = 0; i < N; i++) {
+        pthread_join(order->tids[i], NULL);
+    }
+
+    finishOrder(order, order->results);
+    return NULL;
+}
+
+/*--------------------------------------------------------------------
+   Event-driven mode: put the N sub-factories of an order on the wheel
+----------------------------------------------------------------------*/
+void startLines( order_t *order )
+{
+    gettimeofday(&order->startTime, NULL); // Get start time
+
+    order->linesLeft = N;
+
+    for (int i = 0; i < N; i++) {
+        wheelLine *line = &order->lines[i];
+        memset(line, 0, sizeof(*line));
+        line->args      = lineSpec[i];
+        line->args.order = order;
+        line->res       = &order->results[i];
+        line->res->facID = line->args.facID;
+        line->tmr.fire  = lineStep;
+
+        metricsLineRun(metrics, line->args.facID, +1);
+        printf("Started Factory Line #%-3d with capacity = %-4d parts and duration = %-5d mSecs\n",
+            line->args.facID, line->args.capacity, line->args.duration);
+        schedAfter(&sched, &line->tmr, 0);
+    }
+}
+
+/*--------------------------------------------------------------------
+   A cleared order from the slab, with its arrays pointing into the
+   same block
+----------------------------------------------------------------------*/
+order_t *newOrder( void )
+{
+    char    *block = slabGet(&orderPool);
+    order_t *order = (order_t *) block;
+
+    memset(order, 0, sizeof(*order));
+    order->results = (factoryResults *) (block + offResults);
+    memset(order->results, 0, N * sizeof(factoryResults));
+    if (numWorkers > 0) {
+        order->lines = (wheelLine *) (block + offLines);
+    }
+    else {
+        order->args = (factoryArgs *) (block + offArgs);
+        order->tids = (pthread_t *) (block + offTids);
+    }
+    return order;
+}
+
+/*--------------------------------------------------------------------
+   A UDP socket for the order's reports, bound to the server's port and
+   connected to the client: the route is looked up once instead of on
+   every sendto(), and each order has its own send buffer. The client's
+   later datagrams arrive on it too. -1 (use 'sd') if it can't be set up.
+----------------------------------------------------------------------*/
+int openOrderSocket( struct sockaddr_in *clnt )
+{
+    int on = 1 ;
+    int s  = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (s < 0) {
+        perror("Couldn't create the socket of an order");
+        return -1;
+    }
+    if (setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) < 0 ||
+        bind(s, (SA *) &srvrSkt, sizeof(srvrSkt)) < 0 ||
+        connect(s, (SA *) clnt, sizeof(*clnt)) < 0) {
+        perror("Couldn't connect the socket of an order, using the server socket");
+        close(s);
+        return -1;
+    }
+    return s;
+}
+
+/*--------------------------------------------------------------------
+   The active order placed from 'clnt', if any. Every order leg of a
+   PROCUREMENT has its own socket, so the address identifies the order.
+   Caller holds orders_mutex.
+----------------------------------------------------------------------*/
+order_t *findOrder( struct sockaddr_in *clnt )
+{
+    for (order_t *o = activeOrders; o != NULL; o = o->next) {
+        if (o->client.sin_addr.s_addr == clnt->sin_addr.s_addr &&
+            o->client.sin_port == clnt->sin_port) {
+            return o;
+        }
+    }
+    return NULL;
+}
+
+/*--------------------------------------------------------------------
+   Stop making parts for an order nobody wants any more. Nothing more
+   is claimed; sub-factory threads stop after the iteration they are
+   in, and lines waiting on the timer wheel fire at once and drop the
+   batch they were making. The order then retires as usual and the
+   client is sent its (partial) SUMMARY_MSG. The caller makes sure the
+   order cannot retire meanwhile.
+----------------------------------------------------------------------*/
+void stopOrder( order_t *order , const char *why )
+{
+    pthread_mutex_lock(&order->lock);
+    if (order->stopped != NULL) {
+        pthread_mutex_unlock(&order->lock);
+        return;
+    }
+    metricsOrders(metrics, 0, 0, -order->remainsToMake);
+    order->remainsToMake = 0;
+    __atomic_store_n(&order->stopped, why, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&order->lock);
+
+    printf("\nFACTORY server (by %s ) stopped Order #%d: %s\n", myName, order->id, why);
+    if (numWorkers > 0) {
+        for (int i = 0; i < N; i++) {
+            schedExpedite(&sched, &order->lines[i].tmr);
+        }
+    }
+}
+
+//------------------
+
+void cancelOrder( struct sockaddr_in *clnt )
+{
+    pthread_mutex_lock(&orders_mutex);
+    order_t *order = findOrder(clnt);
+    if (order != NULL) {
+        stopOrder(order, "cancelled by the client");
+    }
+    pthread_mutex_unlock(&orders_mutex);
+}
+
+/*--------------------------------------------------------------------
+   Stop the orders of clients that sent keep-alives and then went quiet.
+   After a hand-off, the keep-alives of an order without a socket of its
+   own come through the replacement; if it is gone, nothing can reach
+   us, so silence proves nothing.
+----------------------------------------------------------------------*/
+void checkClients( void )
+{
+    tick_t now = wheelClock();
+
+    pthread_mutex_lock(&orders_mutex);
+    for (order_t *o = activeOrders; o != NULL; o = o->next) {
+        if (handedOff && o->sock < 0 && successor < 0) {
+            continue;
+        }
+        if (o->keepalive && now - o->lastHeard > CLIENT_TIMEOUT_MS) {
+            stopOrder(o, "no keep-alive from the client");
+        }
+    }
+    pthread_mutex_unlock(&orders_mutex);
+}
+
+/*--------------------------------------------------------------------
+   Handle one datagram that arrived on the server socket
+----------------------------------------------------------------------*/
+void dispatch( msgBuf *rcvMsg , struct sockaddr_in *clntSkt )
+{
+    // Anything from the client of an order shows it is still there
+    pthread_mutex_lock(&orders_mutex);
+    order_t *active = findOrder(clntSkt);
+    if (active != NULL) {
+        active->lastHeard = wheelClock();
+        if (ntohl(rcvMsg->purpose) == KEEPALIVE_MSG) {
+            active->keepalive = 1;
+        }
+    }
+    pthread_mutex_unlock(&orders_mutex);
+
+    // Not ours: it may be for an order the server we took over from is
+    // still draining, whose client sends to the shared socket (-l)
+    msgPurpose_t purpose = ntohl(rcvMsg->purpose);
+    if (active == NULL && predecessor >= 0
+        && (purpose == KEEPALIVE_MSG || purpose == CANCEL_MSG)) {
+        forwardRec rec = { .client = *clntSkt , .msg = *rcvMsg };
+        if (handoffForward(predecessor, &rec, sizeof(rec)) < 0) {
+            close(predecessor);
+            predecessor = -1;
+        }
+    }
+    if (purpose == KEEPALIVE_MSG) {
+        return;
+    }
+
+    printf("\n\nFACTORY server (by %s ) received: ", myName ) ;
+    printMsg( rcvMsg );  puts("");
+
+    char clientIP[IPSTRLEN];
+    inet_ntop(AF_INET, (void *) &clntSkt->sin_addr.s_addr, clientIP, IPSTRLEN);
+    printf("        From IP %s Port %d", clientIP, ntohs(clntSkt->sin_port));
+
+    if (ntohl(rcvMsg->purpose) == CANCEL_MSG) {
+        cancelOrder(clntSkt);
+        return;
+    }
+    if (ntohl(rcvMsg->purpose) != REQUEST_MSG) {
+        printf("\nFACTORY server (by %s ) ignored an unexpected message\n", myName);
+        return;
+    }
+
+    // Set order size
+    int      orderSize = ntohl(rcvMsg->orderSize);
+    unsigned orderID   = ntohl(rcvMsg->orderID);
+
+    // A request for an order we already know is a retry after a lost
+    // reply. Confirm it again while the order runs, or send the summary
+    // once it is over, but never start it twice. Clients that do not
+    // number their orders are recognized by address while it runs.
+    int    retry = 0 , over = 0 ;
+    msgBuf sumMsg;
+    pthread_mutex_lock(&orders_mutex);
+    if (orderSize > 0 && orderID != 0) {
+        dedupEntry *seen = dedupFind(&recentOrders, clntSkt, orderID, wheelClock());
+        if (seen != NULL) {
+            retry = 1;
+            if (seen->state == DEDUP_DONE && seen->partsMade >= 0) {
+                over = 1;
+                memset(&sumMsg, 0, sizeof(sumMsg));
+                sumMsg.purpose   = htonl(SUMMARY_MSG);
+                sumMsg.orderSize = htonl(seen->orderSize);
+                sumMsg.partsMade = htonl(seen->partsMade);
+                sumMsg.numFac    = htonl(N);
+                sumMsg.duration  = htonl(seen->duration);
+                sumMsg.orderID   = htonl(orderID);
+                stampMsg(&sumMsg, 0);
+            }
+        }
+    }
+    else if (orderSize > 0) {
+        retry = findOrder(clntSkt) != NULL;
+    }
+    pthread_mutex_unlock(&orders_mutex);
+
+    if (over) {
+        if (sendto(sd, (void *)&sumMsg, sizeof(sumMsg), 0, (SA *) clntSkt, sizeof(*clntSkt)) < 0) {
+            perror("Error re-sending an order summary");
+            return;
+        }
+        printf("\n\nFACTORY ( by %s ) already finished that order, sent its summary again ", myName );
+        printMsg( &sumMsg );  puts("");
+        return;
+    }
+
+    // Create the confirmation message
+    msgBuf cnfMsg;
+    memset(&cnfMsg, 0, sizeof(cnfMsg));
+    cnfMsg.numFac = htonl(N);
+    cnfMsg.capacity = htonl(advertisedCap);
+    cnfMsg.purpose = htonl(ORDR_CONFIRM);
+    cnfMsg.orderID = htonl(orderID);
+    stampMsg(&cnfMsg, 0);   // reports of the order are numbered from 1
+
+    // Send the confirmation message
+    if (sendto(sd, (void *)&cnfMsg, sizeof(cnfMsg), 0, (SA * ) clntSkt, sizeof(*clntSkt)) < 0) {
+        perror("Error sending the order confirmation message");
+        return;
+    }
+    printf("\n\nFACTORY ( by %s ) sent this Order Confirmation to the client ", myName );
+    printMsg(  & cnfMsg );  puts("");
+
+    // An empty order is a capacity query: the confirmation is the answer
+    if (orderSize == 0 || retry) {
+        return;
+    }
+
+    order_t *order = newOrder();
+    order->client        = *clntSkt;
+    order->orderID       = orderID;
+    order->sock          = legacySend ? -1 : openOrderSocket(clntSkt);
+    order->orderSize     = orderSize;
+    order->remainsToMake = orderSize;
+    order->nextSeq       = 1;
+    order->lastHeard     = wheelClock();
+    pthread_mutex_init(&order->lock, NULL);
+
+    pthread_mutex_lock(&orders_mutex);
+    order->id    = nextOrderID++;
+    if (orderID != 0) {
+        order->cached = dedupAdd(&recentOrders, clntSkt, orderID, wheelClock());
+        if (order->cached != NULL) {
+            order->cached->owner     = order;
+            order->cached->id        = order->id;
+            order->cached->orderSize = orderSize;
+        }
+    }
+    order->next  = activeOrders;
+    activeOrders = order;
+    numActiveOrders++;
+    pthread_mutex_unlock(&orders_mutex);
+    metricsOrders(metrics, 1, 0, orderSize);
+
+    if (numWorkers > 0) {
+        startLines(order);
+    }
+    else {
+        pthread_t tid;
+        Pthread_create(&tid, NULL, orderThread, order);
+        Pthread_detach(tid);
+    }
+}
+
 /*-------------------------------------------------------*/
 int main( int argc , char *argv[] )
 {
+    if (pipe(wakePipe) < 0) {
+        err_sys("Couldn't create the wake-up pipe");
+    }
     sigactionWrapper(SIGTERM, goodbye);
     sigactionWrapper(SIGINT, goodbye);
- 
+
     unsigned short port = 50015 ;      /* service port number  */
-    int    N = 1 ;                     /* Num threads serving the client */
+    int    upgrade = 0 ;               /* take over from a running server */
     socklen_t     addrLen;          /* from-address length          */
 
     printf("\nThis is the FACTORY server (by %s )\n\n" , myName ) ;
     fflush( stdout ) ;
 
-	switch (argc) 
+    int opt ;
+    while ( ( opt = getopt( argc , argv , "ltuw:" ) ) != -1 )
+    {
+        switch ( opt ) {
+          case 'l':
+            legacySend = 1 ;
+            break ;
+          case 't':
+            timeSends = 1 ;
+            break ;
+          case 'u':
+            upgrade = 1 ;
+            break ;
+          case 'w':
+            numWorkers = atoi( optarg ) ;
+            break ;
+          default:
+            printf( "FACTORY Usage: %s [-u] [-l] [-t] [-w numWorkers] [numThreads] [port]\n" , argv[0] );
+            exit( 1 ) ;
+        }
+    }
+
+	switch (argc - optind)
 	{
-      case 1:
+      case 0:
         break ;     // use default port with a single factory thread
-      
-      case 2:
-        N = atoi( argv[1] ); // get from command line
+
+      case 1:
+        N = atoi( argv[optind] ); // get from command line
         port = 50015;            // use this port by default
         break;
 
-      case 3:
-        N    = atoi( argv[1] ) ; // get from command line
-        port = atoi( argv[2] ) ; // use port from command line
+      case 2:
+        N    = atoi( argv[optind] ) ;   // get from command line
+        port = atoi( argv[optind+1] ) ; // use port from command line
         break;
 
       default:
-        printf( "FACTORY Usage: %s [numThreads] [port]\n" , argv[0] );
+        printf( "FACTORY Usage: %s [-u] [-l] [-t] [-w numWorkers] [numThreads] [port]\n" , argv[0] );
         exit( 1 ) ;
     }
 
     printf("I will attempt to accept orders at port %hu with %d sub-factories\n\n", port, N);
+    if (numWorkers > 0) {
+        printf("Sub-factories are event-driven lines on a timer wheel run by %d worker thread(s)\n\n", numWorkers);
+        schedStart(&sched, numWorkers);
+    }
     fflush(stdout);
 
-    // Create the socket
-    sd = socket(AF_INET, SOCK_DGRAM, 0);
-    if (sd < 0) {
-        err_sys("Couldn't create a UDP socket");
+    // Pick each sub-factory's capacity and duration once, so the capacity
+    // advertised in ORDR_CONFIRM is what every order will actually get
+    srandom((unsigned) time(NULL) ^ getpid()); // Create random number generator seed
+    lineSpec = calloc(N, sizeof(factoryArgs));
+    if (lineSpec == NULL) {
+        err_sys("Couldn't allocate the sub-factory table");
+    }
+    double partsPerSec = 0;
+    for (int i = 0; i < N; i++) {
+        lineSpec[i].facID     = i + 1;
+        lineSpec[i].capacity  = (random() % 41) + 10;     // random number from 10–50
+        lineSpec[i].duration  = (random() % 701) + 500;   // random number from 500–1200
+        partsPerSec += lineSpec[i].capacity * 1000.0 / lineSpec[i].duration;
+    }
+    advertisedCap = (unsigned) (partsPerSec + 0.5);
+    printf("Advertised capacity is %u parts/sec\n\n", advertisedCap);
+
+    // Lay out an order's slab block: the order, its results, then the
+    // lines (event-driven) or the thread arguments and ids, each part
+    // starting on a cache line of its own
+    size_t blockSize = CACHE_ALIGN(sizeof(order_t));
+    offResults = blockSize;
+    blockSize += CACHE_ALIGN(N * sizeof(factoryResults));
+    if (numWorkers > 0) {
+        offLines   = blockSize;
+        blockSize += CACHE_ALIGN(N * sizeof(wheelLine));
+    }
+    else {
+        offArgs    = blockSize;
+        blockSize += CACHE_ALIGN(N * sizeof(factoryArgs));
+        offTids    = blockSize;
+        blockSize += CACHE_ALIGN(N * sizeof(pthread_t));
     }
+    slabInit(&orderPool, blockSize, ORDER_PREALLOC);
 
-    // Prepare the server's socket address
-    memset( (void *) &srvrSkt, 0, sizeof(srvrSkt));
-    srvrSkt.sin_family = AF_INET;
-    srvrSkt.sin_port = htons(port);
-    srvrSkt.sin_addr.s_addr = htonl(INADDR_ANY);
+    handoffPath( port , upgradeSock , sizeof(upgradeSock) ) ;
+    dedupInit( &recentOrders , ORDER_CACHE_SIZE , ORDER_CACHE_TTL_MS ) ;
 
-    // Bind the server to the socket
-    int status = bind(sd , (SA *) &srvrSkt, sizeof(srvrSkt));
-    if (status < 0) {
-        err_sys("Couldn't bind the socket to the server");
+    if ( upgrade ) {
+        // Inherit the bound socket, so no request is dropped in between
+        takeOver( port ) ;
     }
+    else {
+        // Create the socket
+        sd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (sd < 0) {
+            err_sys("Couldn't create a UDP socket");
+        }
+
+        // Prepare the server's socket address
+        memset( (void *) &srvrSkt, 0, sizeof(srvrSkt));
+        srvrSkt.sin_family = AF_INET;
+        srvrSkt.sin_port = htons(port);
+        srvrSkt.sin_addr.s_addr = htonl(INADDR_ANY);
+
+        // Bind the server to the socket. This fails if the port is
+        // taken, by another factory too: sharing it needs SO_REUSEADDR
+        // on both sockets, and it is not set on this one yet.
+        int status = bind(sd , (SA *) &srvrSkt, sizeof(srvrSkt));
+        if (status < 0) {
+            err_sys("Couldn't bind the socket to the server");
+        }
+
+        // Order sockets bind the same port, so allow the sharing from now on
+        int on = 1;
+        if (setsockopt(sd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) < 0) {
+            err_sys("Couldn't set SO_REUSEADDR on the server socket");
+        }
+    }
+
+    // Counters for factory-top; a replacement server keeps them going.
+    // Only once the port is ours, so a server started on a busy port by
+    // mistake leaves the running one's counters alone.
+    metrics = metricsCreate(port, N, numWorkers, upgrade);
 
     // Print the socket status
     char    ipStr[ IPSTRLEN ] ;    /* dotted-dec IP addr. */
     inet_ntop( AF_INET, (void *) & srvrSkt.sin_addr.s_addr , ipStr , IPSTRLEN ) ;
     printf( "Bound socket %d to IP %s Port %d\n" , sd , ipStr , ntohs( srvrSkt.sin_port ) );
-    
 
-    int forever = 1;
-    while ( forever )
+    startUpgradeListener() ;
+
+    // Serve requests until a replacement takes the socket over, then
+    // keep serving the accepted orders' own sockets until they finish
+    struct pollfd *pfd      = NULL ;
+    int            pfdCap   = 0 ;
+    int            draining = 0 ;
+    while ( 1 )
     {
-        // Variables to measure the time
-        struct timeval startTime, endTime;
-        long elapsedMS;
+        pthread_mutex_lock(&orders_mutex);
+        for (int i = 0; i < numRetired; i++) {
+            close(retiredSocks[i]);
+        }
+        numRetired = 0;
+        if ( handedOff && !draining ) {
+            printf("\nFACTORY server ( by %s ) handed over to a new server, draining %d order(s)\n"
+                   , myName, numActiveOrders);
+            draining = 1 ;
+        }
+        // A server we took over from may still need us to pass on what
+        // its clients send, so stay until it is gone too
+        if ( handedOff && numActiveOrders == 0 && predecessor < 0 ) {
+            pthread_mutex_unlock(&orders_mutex);
+            break ;
+        }
+        if ( pfdCap < 4 + numActiveOrders ) {
+            pfdCap = 2 * ( 4 + numActiveOrders ) ;
+            pfd    = realloc( pfd , pfdCap * sizeof(struct pollfd) ) ;
+            if ( pfd == NULL )
+                err_sys("Couldn't grow the poll set");
+        }
+        int nfds = 0 , timeout = numActiveOrders > 0 ? LIVENESS_CHECK_MS : -1 ;
+        pfd[nfds++] = (struct pollfd) { .fd = handedOff ? -1 : sd , .events = POLLIN } ;
+        pfd[nfds++] = (struct pollfd) { .fd = wakePipe[0] , .events = POLLIN } ;
+        pfd[nfds++] = (struct pollfd) { .fd = successor , .events = POLLIN } ;
+        pfd[nfds++] = (struct pollfd) { .fd = predecessor , .events = POLLIN } ;
+        for (order_t *o = activeOrders; o != NULL; o = o->next) {
+            if ( o->sock >= 0 )
+                pfd[nfds++] = (struct pollfd) { .fd = o->sock , .events = POLLIN } ;
+        }
+        pthread_mutex_unlock(&orders_mutex);
 
-        // Array to store the factory thread result structs
-        factoryResults results[N]; 
+        if ( !handedOff )
+            printf( "\nFACTORY server ( by %s ) waiting for Order Requests\n", myName ) ;
+        fflush( stdout ) ;
 
-        addrLen = sizeof(clntSkt);
-        printf( "\nFACTORY server ( by %s ) waiting for Order Requests\n", myName ) ; 
+        // Wait for a request, a message about an order, a signal, a
+        // finished order, or a replacement server. Look at the clients'
+        // keep-alives every now and then while orders are running.
+        while ( poll( pfd , nfds , timeout ) < 0 ) {
+            if ( errno != EINTR )
+                err_sys("Error waiting for order requests");
+            if ( stopSig )
+                break ;
+        }
+        if ( stopSig )
+            terminateServer( stopSig ) ;
+        checkClients() ;
+        if ( pfd[1].revents & POLLIN ) {
+            char c[ 64 ] ;
+            read( wakePipe[0] , c , sizeof(c) ) ;
+            continue ;
+        }
 
-        // Wait to receive request message
-        msgBuf rcvMsg;
-        if (recvfrom(sd, (void *) &rcvMsg, sizeof(rcvMsg), 0, (SA *) &clntSkt, &addrLen) < 0) {
-            err_sys("Error receiving the order request from the client");
+        // Messages for our orders that reached the replacement
+        if ( pfd[2].revents ) {
+            forwardRec rec ;
+            if ( handoffForwarded( successor , &rec , sizeof(rec) ) < 0 ) {
+                close( successor ) ;
+                successor = -1 ;
+            }
+            else
+                dispatch( &rec.msg , &rec.client ) ;
+        }
+        // The server we took over from never writes: it has exited
+        if ( pfd[3].revents ) {
+            close( predecessor ) ;
+            predecessor = -1 ;
         }
-        printf("\n\nFACTORY server (by %s ) received: ", myName ) ;
-        printMsg( & rcvMsg );  puts("");
 
-        char clientIP[IPSTRLEN];
-        inet_ntop(AF_INET, (void *) &clntSkt.sin_addr.s_addr, clientIP, IPSTRLEN);
-        printf("        From IP %s Port %d", clientIP, ntohs(clntSkt.sin_port));
-
-        // Set order size and remainsToMake
-        orderSize = ntohl(rcvMsg.orderSize);
-
-        pthread_mutex_lock(&remains_mutex);
-        remainsToMake += orderSize;
-        pthread_mutex_unlock(&remains_mutex);
-
-        // Create the confirmation message
-        msgBuf cnfMsg;
-        cnfMsg.numFac = htonl(N);
-        cnfMsg.purpose = htonl(ORDR_CONFIRM);
-
-        // Send the confirmation message
-        if (sendto(sd, (void *)&cnfMsg, sizeof(cnfMsg), 0, (SA * ) &clntSkt, sizeof(clntSkt)) < 0) {
-            err_sys("Error sending the order confirmation message");
-        }
-        printf("\n\nFACTORY ( by %s ) sent this Order Confirmation to the client ", myName );
-        printMsg(  & cnfMsg );  puts("");
-        
-        gettimeofday(&startTime, NULL); // Get start time
-     
-        pthread_t tids[N]; // Array to store each thread's id
-        srandom((unsigned) time(NULL)); // Create random number generator seed 
-        
-        //Create N threads
-        for (int i = 0; i < N; i++) {
-            // Set the argument struct for the thread 
-            factoryArgs *args = malloc(sizeof(factoryArgs));
-            args->facID = i + 1;
-            args->capacity  = (random() % 41) + 10;     // random number from 10–50
-            args->duration  = (random() % 701) + 500;   // random number from 500–1200
+        for (int i = 0; i < nfds; i++) {
+            if ( ( i >= 1 && i <= 3 ) || !( pfd[i].revents & (POLLIN | POLLERR) ) )
+                continue ;
+
+            msgBuf rcvMsg;
+            struct sockaddr_in clntSkt;
+            addrLen = sizeof(clntSkt);
+            ssize_t n = recvfrom(pfd[i].fd, (void *) &rcvMsg, sizeof(rcvMsg), MSG_DONTWAIT, (SA *) &clntSkt, &addrLen);
+            if (n < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+                    continue;   // the new server read it first during a hand-off
+                if (i > 0) {
+                    // ECONNREFUSED & co on an order's socket: its client is gone
+                    pthread_mutex_lock(&orders_mutex);
+                    for (order_t *o = activeOrders; o != NULL; o = o->next) {
+                        if (o->sock == pfd[i].fd) {
+                            stopOrder(o, "the client is gone");
+                        }
+                    }
+                    pthread_mutex_unlock(&orders_mutex);
+                    continue;
+                }
+                err_sys("Error receiving the order request from the client");
+            }
+            if (n != sizeof(rcvMsg)) {
+                printf("\nFACTORY server (by %s ) ignored a %zd-byte datagram\n", myName, n);
+                continue;
+            }
 
-            pthread_create(&tids[i], NULL, subFactoryThread, args);
-            printf("Created Factory Thread #%-3d with capacity = %-4d parts and duration = %-5d mSecs\n",
-                args->facID, args->capacity, args->duration);
+            dispatch( &rcvMsg , &clntSkt ) ;
         }
+    }
+    free( pfd ) ;
 
-        // Wait for all factories to finish
-        for (int i = 0; i < N; i++) {
-            factoryResults *threadRes;
-            pthread_join(tids[i], (void **)&threadRes);
+    printf("\nFACTORY server ( by %s ) drained, exiting\n", myName);
+    metricsRelease( metrics , port , 0 ) ;
+    close( sd ) ;
+    return 0 ;
+}
 
-            // Store the result of the thread in the result array
-            results[i] = *threadRes;
-            free(threadRes);
-        }
+/*--------------------------------------------------------------------
+   Steps shared by both kinds of sub-factory
+----------------------------------------------------------------------*/
 
-        // get ending time and calculate total time
-        gettimeofday(&endTime, NULL); 
-        elapsedMS = (endTime.tv_sec - startTime.tv_sec) * 1000L +
-            (endTime.tv_usec - startTime.tv_usec) / 1000L;
+// Send a message to the order's client, on the order's own socket when
+// it has one. Counts the datagrams, failures and, with -t, the CPU
+// they cost.
+void sendToClient( order_t *order , msgBuf *msg , const char *what )
+{
+    unsigned long long start = timeSends ? threadCpuNs() : 0;
+    ssize_t n;
 
-        printf("\n****** FACTORY Server (by %s ) Summary Report ******\n", myName);
-        printf("\tSub-Factory\tParts Made\tIterations\n");
+    msg->orderID = htonl(order->orderID);
 
-        // Go through the results array to find the total parts made and iterations of each thread
-        int totalMade;
-        for (int i = 0; i < N; i++) {
-            printf("\t\t%-3d\t\t%-5d\t\t%-3d\n", results[i].facID, results[i].totalParts, results[i].iterations);
-            totalMade += results[i].totalParts;
+    if (order->sock >= 0) {
+        n = send(order->sock, (void *) msg, sizeof(*msg), 0);
+    }
+    else {
+        n = sendto(sd, (void *) msg, sizeof(*msg), 0, (SA *) &order->client, sizeof(order->client));
+    }
+
+    if (timeSends) {
+        __atomic_fetch_add(&order->sendNs, threadCpuNs() - start, __ATOMIC_RELAXED);
+    }
+    __atomic_fetch_add(&order->sends, 1, __ATOMIC_RELAXED);
+    if (n < 0) {
+        int err = errno;
+        __atomic_fetch_add(&order->sendErrors, 1, __ATOMIC_RELAXED);
+        metricsSendError(metrics);
+        perror(what);
+        if (err == ECONNREFUSED) {
+            stopOrder(order, "the client is gone");
         }
+    }
+}
 
-        // Print final results
-        printf("======================================================\n");
-        printf("Grand total parts made  =   %-5d vs order size %-5d\n", totalMade, orderSize);
-        printf("Order-to-Completion time =  %.1f milliSeconds\n", elapsedMS);
+// Claim up to 'myCapacity' parts of the order; 0 when nothing is left
+int claimParts( order_t *order , int myCapacity )
+{
+    int partsToMake = 0;
+
+    pthread_mutex_lock(&order->lock);
+    if ( order->remainsToMake > 0 ) {
+        partsToMake = minimum(order->remainsToMake, myCapacity);
+        order->remainsToMake -= partsToMake;
+    }
+    pthread_mutex_unlock(&order->lock);
+
+    if ( partsToMake > 0 )
+        metricsOrders(metrics, 0, 0, -partsToMake);
+
+    return partsToMake;
+}
+
+// Send a Production Message to Supervisor
+void reportProduction( order_t *order , int factoryID , int myCapacity , int partsMade , int myDuration )
+{
+    msgBuf  msg;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.facID = htonl(factoryID);
+    msg.capacity = htonl(myCapacity);
+    msg.partsMade = htonl(partsMade);
+    msg.duration = htonl(myDuration);
+    msg.purpose = htonl(PRODUCTION_MSG);
+    stampMsg(&msg, __atomic_fetch_add(&order->nextSeq, 1, __ATOMIC_RELAXED));
+
+    sendToClient(order, &msg, "Error sending production message");
+    metricsLineIter(metrics, factoryID, partsMade);
+}
+
+// Send a Completion Message to Supervisor
+void reportCompletion( order_t *order , int factoryID , int partsImade , int myIterations )
+{
+    char    strBuff[ MAXSTR ] ;   // snprint buffer
+    msgBuf  cmpMsg;
+
+    memset(&cmpMsg, 0, sizeof(cmpMsg));
+    cmpMsg.facID = htonl(factoryID);
+    cmpMsg.purpose = htonl(COMPLETION_MSG);
+    stampMsg(&cmpMsg, __atomic_fetch_add(&order->nextSeq, 1, __ATOMIC_RELAXED));
+
+    sendToClient(order, &cmpMsg, "Error sending completion message");
+
+    snprintf( strBuff , MAXSTR , ">>> Factory # %-3d: Terminating after making total of %-5d parts in %-4d iterations\n"
+          , factoryID, partsImade, myIterations);
+    factLog( strBuff ) ;
+}
+
+/*--------------------------------------------------------------------
+   Event-driven sub-factory: runs on a wheel worker every time the
+   line's timer expires
+----------------------------------------------------------------------*/
+void lineStep( wheelTimer *t )
+{
+    wheelLine   *line  = (wheelLine *) t ;
+    factoryArgs *args  = &line->args ;
+    order_t     *order = args->order ;
+
+    // Stopped orders drop the batch that was cut short
+    if ( line->pending > 0 && __atomic_load_n(&order->stopped, __ATOMIC_ACQUIRE) != NULL
+         && wheelClock() < line->due ) {
+        line->pending = 0;
+    }
+
+    // The batch claimed last time is done: report it
+    if ( line->pending > 0 ) {
+        line->res->totalParts += line->pending;
+        line->res->iterations++;
+
+        printf("Factory (%s) #%3d: Going to make %5d parts in %4d mSec\n", myName, args->facID, line->pending, args->duration);
+        reportProduction(order, args->facID, args->capacity, line->pending, args->duration);
+        line->pending = 0;
+    }
+
+    // Claim the next batch and come back when it is made
+    line->pending = claimParts(order, args->capacity);
+    if ( line->pending > 0 ) {
+        line->due = wheelClock() + args->duration;
+        schedAfter(&sched, t, args->duration);
+        return;
+    }
+
+    metricsLineRun(metrics, args->facID, -1);
+    reportCompletion(order, args->facID, line->res->totalParts, line->res->iterations);
+    if ( __atomic_sub_fetch(&order->linesLeft, 1, __ATOMIC_ACQ_REL) == 0 ) {
+        finishOrder(order, order->results);
     }
-    return 0 ;
 }
 
 // Thread routine
 void *subFactoryThread(void *arg) {
     factoryArgs *args = (factoryArgs *)arg;
-    factoryResults *res = malloc(sizeof(factoryResults));
+    factoryResults *res = &args->order->results[args->facID - 1];
 
     // Each thread calls the subFactory() method
-    subFactory(args->facID, args->capacity, args->duration, res);
-    free(args);
-    return res;
+    subFactory(args->order, args->facID, args->capacity, args->duration, res);
+    return NULL;
 }
 
-void subFactory( int factoryID , int myCapacity , int myDuration, factoryResults *res)
+void subFactory( order_t *order , int factoryID , int myCapacity , int myDuration, factoryResults *res)
 {
-    char    strBuff[ MAXSTR ] ;   // snprint buffer
     int     partsImade = 0 , myIterations = 0 ;
-    msgBuf  msg;
 
-    
+    metricsLineRun(metrics, factoryID, +1);
     while (1)
     {
         // See if there are still any parts to manufacture
-        pthread_mutex_lock(&remains_mutex);
-        if ( remainsToMake <= 0 ) {
-            pthread_mutex_unlock(&remains_mutex);
+        int partsToMake = claimParts(order, myCapacity);
+        if ( partsToMake == 0 ) {
             break ;   // Not anymore, exit the loop
         }
 
-        // Calculate how many parts to make and sleep for the duration
-        int partsToMake = minimum(remainsToMake, myCapacity);
-        remainsToMake -= partsToMake;
-        pthread_mutex_unlock(&remains_mutex);
-
+        // Sleep for the duration
         Usleep(myDuration * 1000);
         partsImade += partsToMake;
         myIterations++;
@@ -296,34 +1245,17 @@ void subFactory( int factoryID , int myCapacity , int myDuration, factoryResults
         printf("Factory (%s) #%3d: Going to make %5d parts in %4d mSec\n", myName, factoryID, partsToMake, myDuration);
 
         // Send a Production Message to Supervisor
-        msg.facID = htonl(factoryID);
-        msg.capacity = htonl(myCapacity);
-        msg.partsMade = htonl(partsToMake);
-        msg.duration = htonl(myDuration);
-        msg.purpose = htonl(PRODUCTION_MSG);
-
-        if (sendto(sd, (void *) &msg, sizeof(msg), 0, (SA *) &clntSkt, sizeof(clntSkt)) < 0) {
-            err_sys("Error sending production message");
-        }
+        reportProduction(order, factoryID, myCapacity, partsToMake, myDuration);
     }
 
     res->facID = factoryID;
     res->iterations = myIterations;
     res->totalParts = partsImade;
+    metricsLineRun(metrics, factoryID, -1);
 
     // Send a Completion Message to Supervisor
-    msgBuf cmpMsg;
-    cmpMsg.facID = htonl(factoryID);
-    cmpMsg.purpose = htonl(COMPLETION_MSG);
-
-    if (sendto(sd, (void *) &cmpMsg, sizeof(cmpMsg), 0, (SA *) &clntSkt, sizeof(clntSkt)) < 0) {
-        err_sys("Error sending completion message");
-    }
-
-    snprintf( strBuff , MAXSTR , ">>> Factory # %-3d: Terminating after making total of %-5d parts in %-4d iterations\n" 
-          , factoryID, partsImade, myIterations);
-    factLog( strBuff ) ;
+    reportCompletion(order, factoryID, partsImade, myIterations);
 }
 // lab computers
 // L24820 L24821
-// L24814
\ No newline at end of file
+// L24814
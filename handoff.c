@@ -0,0 +1,272 @@
+//---------------------------------------------------------------------
+// Assignment : PA-04 Threads - UDP
+// Date       : 12/1/2025
+// Author     : Kyle Mirra      Akwasi Okyere
+// File Name  : handoff.c
+//---------------------------------------------------------------------
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "handoff.h"
+
+/*--------------------------------------------------------------------
+   Where the server listening on 'port' accepts its replacement
+----------------------------------------------------------------------*/
+void handoffPath( unsigned short port , char *buf , size_t len )
+{
+    snprintf( buf , len , "/tmp/factory-%hu.upgrade" , port ) ;
+}
+
+//------------------
+
+static int fillAddr( struct sockaddr_un *addr , const char *path )
+{
+    memset( (void *) addr , 0 , sizeof( *addr ) ) ;
+    addr->sun_family = AF_UNIX ;
+    if ( strlen( path ) >= sizeof( addr->sun_path ) ) {
+        errno = ENAMETOOLONG ;
+        return -1 ;
+    }
+    strcpy( addr->sun_path , path ) ;
+    return 0 ;
+}
+
+//------------------
+
+static int writeAll( int fd , const void *buf , size_t len )
+{
+    const char *p = buf ;
+    while ( len > 0 ) {
+        ssize_t n = send( fd , p , len , MSG_NOSIGNAL ) ;
+        if ( n < 0 ) {
+            if ( errno == EINTR )  continue ;
+            return -1 ;
+        }
+        p   += n ;
+        len -= n ;
+    }
+    return 0 ;
+}
+
+//------------------
+
+static int readAll( int fd , void *buf , size_t len )
+{
+    char *p = buf ;
+    while ( len > 0 ) {
+        ssize_t n = read( fd , p , len ) ;
+        if ( n < 0 ) {
+            if ( errno == EINTR )  continue ;
+            return -1 ;
+        }
+        if ( n == 0 ) {
+            errno = EPIPE ;
+            return -1 ;
+        }
+        p   += n ;
+        len -= n ;
+    }
+    return 0 ;
+}
+
+/*--------------------------------------------------------------------
+   Listen for a replacement on 'path'. A leftover path from a server
+   that died without cleaning up is removed first; one that a running
+   server still listens on is left alone (EADDRINUSE).
+----------------------------------------------------------------------*/
+int handoffListen( const char *path )
+{
+    struct sockaddr_un addr ;
+    int                lsd ;
+
+    if ( fillAddr( &addr , path ) < 0 )
+        return -1 ;
+
+    if ( ( lsd = socket( AF_UNIX , SOCK_STREAM , 0 ) ) < 0 )
+        return -1 ;
+
+    // Someone answers: the path is in use. The probe sends no
+    // HANDOFF_REQUEST, so that server does not hand anything over.
+    if ( connect( lsd , (struct sockaddr *) &addr , sizeof( addr ) ) == 0 ) {
+        close( lsd ) ;
+        errno = EADDRINUSE ;
+        return -1 ;
+    }
+    close( lsd ) ;
+    if ( ( lsd = socket( AF_UNIX , SOCK_STREAM , 0 ) ) < 0 )
+        return -1 ;
+
+    unlink( path ) ;
+    if ( bind( lsd , (struct sockaddr *) &addr , sizeof( addr ) ) < 0
+         || listen( lsd , 1 ) < 0 ) {
+        int saved = errno ;
+        close( lsd ) ;
+        errno = saved ;
+        return -1 ;
+    }
+    return lsd ;
+}
+
+/*--------------------------------------------------------------------
+   Wait for a replacement on the listening socket 'lsd'. Connections
+   that do not ask for a hand-off (such as handoffListen()'s probe of
+   the path) are dropped.
+----------------------------------------------------------------------*/
+int handoffAccept( int lsd )
+{
+    while ( 1 )
+    {
+        int conn = accept( lsd , NULL , NULL ) ;
+        if ( conn < 0 ) {
+            if ( errno == EINTR || errno == ECONNABORTED )  continue ;
+            return -1 ;
+        }
+
+        char    c ;
+        ssize_t n ;
+        while ( ( n = read( conn , &c , 1 ) ) < 0 && errno == EINTR )
+            ;
+        if ( n == 1 && c == HANDOFF_REQUEST )
+            return conn ;
+        close( conn ) ;
+    }
+}
+
+/*--------------------------------------------------------------------
+   Send descriptor 'fd' followed by 'len' bytes of state on 'conn'.
+   The length travels with the descriptor so the receiver knows how
+   much state follows.
+----------------------------------------------------------------------*/
+int handoffSend( int conn , int fd , const void *state , size_t len )
+{
+    uint32_t        stateLen = (uint32_t) len ;
+    struct iovec    iov = { .iov_base = &stateLen , .iov_len = sizeof( stateLen ) } ;
+    struct msghdr   msg ;
+    union {
+        char           buf[ CMSG_SPACE( sizeof( int ) ) ] ;
+        struct cmsghdr align ;
+    } ctl ;
+
+    memset( &msg , 0 , sizeof( msg ) ) ;
+    memset( &ctl , 0 , sizeof( ctl ) ) ;
+    msg.msg_iov        = &iov ;
+    msg.msg_iovlen     = 1 ;
+    msg.msg_control    = ctl.buf ;
+    msg.msg_controllen = sizeof( ctl.buf ) ;
+
+    struct cmsghdr *cm = CMSG_FIRSTHDR( &msg ) ;
+    cm->cmsg_level = SOL_SOCKET ;
+    cm->cmsg_type  = SCM_RIGHTS ;
+    cm->cmsg_len   = CMSG_LEN( sizeof( int ) ) ;
+    memcpy( CMSG_DATA( cm ) , &fd , sizeof( int ) ) ;
+
+    while ( sendmsg( conn , &msg , MSG_NOSIGNAL ) < 0 )
+        if ( errno != EINTR )
+            return -1 ;
+
+    return writeAll( conn , state , len ) ;
+}
+
+/*--------------------------------------------------------------------
+   Connect to the server listening on 'path' and take over its socket.
+   On success '*state' is a malloc'ed copy of the state it sent, the
+   old server has released 'path', and '*link' is the connection to it
+   (-1 if it closed the connection instead).
+----------------------------------------------------------------------*/
+int handoffReceive( const char *path , int *fd , void **state , size_t *len , int *link )
+{
+    struct sockaddr_un addr ;
+    int                conn ;
+    uint32_t           stateLen ;
+    struct iovec       iov = { .iov_base = &stateLen , .iov_len = sizeof( stateLen ) } ;
+    struct msghdr      msg ;
+    union {
+        char           buf[ CMSG_SPACE( sizeof( int ) ) ] ;
+        struct cmsghdr align ;
+    } ctl ;
+
+    if ( fillAddr( &addr , path ) < 0 )
+        return -1 ;
+    if ( ( conn = socket( AF_UNIX , SOCK_STREAM , 0 ) ) < 0 )
+        return -1 ;
+    if ( connect( conn , (struct sockaddr *) &addr , sizeof( addr ) ) < 0 )
+        goto fail ;
+
+    char req = HANDOFF_REQUEST ;
+    if ( writeAll( conn , &req , 1 ) < 0 )
+        goto fail ;
+
+    memset( &msg , 0 , sizeof( msg ) ) ;
+    msg.msg_iov        = &iov ;
+    msg.msg_iovlen     = 1 ;
+    msg.msg_control    = ctl.buf ;
+    msg.msg_controllen = sizeof( ctl.buf ) ;
+
+    ssize_t n ;
+    while ( ( n = recvmsg( conn , &msg , MSG_CMSG_CLOEXEC ) ) < 0 )
+        if ( errno != EINTR )
+            goto fail ;
+
+    struct cmsghdr *cm = CMSG_FIRSTHDR( &msg ) ;
+    if ( n != sizeof( stateLen ) || cm == NULL
+         || cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS ) {
+        errno = EPROTO ;
+        goto fail ;
+    }
+    memcpy( fd , CMSG_DATA( cm ) , sizeof( int ) ) ;
+
+    *len   = stateLen ;
+    *state = malloc( stateLen ? stateLen : 1 ) ;
+    if ( *state == NULL || readAll( conn , *state , stateLen ) < 0 ) {
+        int saved = errno ;
+        free( *state ) ;
+        close( *fd ) ;
+        close( conn ) ;
+        errno = saved ;
+        return -1 ;
+    }
+
+    // Wait for the old server to let go of the path
+    char c ;
+    while ( ( n = read( conn , &c , 1 ) ) < 0 && errno == EINTR )
+        ;
+    if ( n == 1 && c == HANDOFF_RELEASED )
+        *link = conn ;
+    else {
+        *link = -1 ;
+        close( conn ) ;
+    }
+    return 0 ;
+
+fail:
+    {
+        int saved = errno ;
+        close( conn ) ;
+        errno = saved ;
+    }
+    return -1 ;
+}
+
+/*--------------------------------------------------------------------
+   One fixed-size record over the link between an old server and its
+   replacement. Both return -1 if the other side is gone.
+----------------------------------------------------------------------*/
+int handoffForward( int link , const void *rec , size_t len )
+{
+    return writeAll( link , rec , len ) ;
+}
+
+//------------------
+
+int handoffForwarded( int link , void *rec , size_t len )
+{
+    return readAll( link , rec , len ) ;
+}
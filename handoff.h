@@ -0,0 +1,39 @@
+//---------------------------------------------------------------------
+// Assignment : PA-04 Threads - UDP
+// Date       : 12/1/2025
+// Author     : Kyle Mirra      Akwasi Okyere
+// File Name  : handoff.h
+//---------------------------------------------------------------------
+
+#ifndef  HANDOFF_H
+#define  HANDOFF_H
+
+#include <stddef.h>
+
+/*--------------------------------------------------------------------
+   Passing a bound socket and a blob of state from a running server to
+   its replacement over a Unix domain socket (SCM_RIGHTS).
+
+   The running server listens on handoffPath(); the replacement connects,
+   asks for the hand-off with one HANDOFF_REQUEST byte, receives the
+   descriptor and the state, and then waits for one HANDOFF_RELEASED
+   byte. The old server unlinks the path before sending it, so once
+   handoffReceive() returns the replacement may listen on the same path.
+
+   The connection then stays open as a link between the two: the new
+   server passes on what arrives for the orders the old one is still
+   draining (handoffForward / handoffForwarded). EOF on it means the
+   other side is gone.
+----------------------------------------------------------------------*/
+#define HANDOFF_REQUEST   'U'
+#define HANDOFF_RELEASED  'R'
+
+void  handoffPath   ( unsigned short port , char *buf , size_t len ) ;
+int   handoffListen ( const char *path ) ;
+int   handoffAccept ( int lsd ) ;
+int   handoffSend   ( int conn , int fd , const void *state , size_t len ) ;
+int   handoffReceive( const char *path , int *fd , void **state , size_t *len , int *link ) ;
+int   handoffForward  ( int link , const void *rec , size_t len ) ;
+int   handoffForwarded( int link , void *rec , size_t len ) ;
+
+#endif
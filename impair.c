@@ -0,0 +1,338 @@
+//---------------------------------------------------------------------
+// Assignment : PA-04 Threads - UDP
+// Date       : 12/1/2025
+// Author     : Kyle Mirra      Akwasi Okyere
+// File Name  : impair.c
+//
+// A UDP proxy that does to the datagrams between PROCUREMENT and a
+// FACTORY server what a bad network would: loss, duplication,
+// reordering, delay with jitter, and a bandwidth limit.
+//
+//      ./impair [options] <listenPort> <FactoryServerIP> <port>
+//
+// Clients send to listenPort. Every client address gets its own socket
+// towards the server, so the server still tells the clients apart.
+// Datagrams wait on a timer wheel until they are due, all in one thread.
+//---------------------------------------------------------------------
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <time.h>
+#include <poll.h>
+
+#include "wrappers.h"
+#include "wheel.h"
+
+#define MAXDGRAM        1500
+#define MAXSESSIONS     256
+#define SESSION_IDLE_MS 60000      // forget a client quiet this long
+#define IPSTRLEN        50
+
+typedef struct sockaddr SA ;
+
+// One direction of the path, with its own bandwidth queue and counters
+enum { UPSTREAM , DOWNSTREAM } ;
+
+typedef struct {
+    tick_t          freeAt ;        // when the link is done sending what it has
+    unsigned long   received , forwarded , dropped , duplicated , reordered ;
+} link_t ;
+
+// A client and the socket that speaks for it to the server
+typedef struct {
+    int                 sd ;        // connected to the server, -1 if unused
+    struct sockaddr_in  client ;
+    tick_t              lastUsed ;
+    unsigned            inFlight ;  // datagrams of it still on the wheel
+} session_t ;
+
+// A datagram on its way; 'tmr' must be first
+typedef struct packet {
+    wheelTimer  tmr ;
+    int         session , dir ;
+    size_t      len ;
+    char        data[] ;
+} packet_t ;
+
+/*-------------------------------------------------------*/
+
+double      lossPct , dupPct , reorderPct ;
+long        delayMS , jitterMS , reorderMS = -1 ;
+long        kbps ;                  // 0: no bandwidth limit
+
+int                 lsd ;           // where the clients send to
+struct sockaddr_in  server ;
+session_t           sessions[ MAXSESSIONS ] ;
+link_t              links[ 2 ] ;
+timerWheel          wheel ;
+
+volatile sig_atomic_t done ;
+
+void stop( int sig )
+{
+    done = sig ;
+}
+
+//------------------
+
+int chance( double pct )
+{
+    return pct > 0 && random() % 1000000 < pct * 10000 ;
+}
+
+/*--------------------------------------------------------------------
+   The session of 'client', set up on first use. -1 if all are taken.
+----------------------------------------------------------------------*/
+int findSession( struct sockaddr_in *client , tick_t now )
+{
+    int freeSlot = -1 ;
+
+    for ( int i = 0 ; i < MAXSESSIONS ; i++ ) {
+        session_t *s = &sessions[i] ;
+        if ( s->sd >= 0 && s->inFlight == 0 && now - s->lastUsed > SESSION_IDLE_MS ) {
+            close( s->sd ) ;
+            s->sd = -1 ;
+        }
+        if ( s->sd < 0 ) {
+            if ( freeSlot < 0 )
+                freeSlot = i ;
+            continue ;
+        }
+        if ( s->client.sin_addr.s_addr == client->sin_addr.s_addr
+             && s->client.sin_port == client->sin_port )
+            return i ;
+    }
+    if ( freeSlot < 0 )
+        return -1 ;
+
+    session_t *s = &sessions[ freeSlot ] ;
+    s->sd = socket( AF_INET , SOCK_DGRAM , 0 ) ;
+    if ( s->sd < 0 )
+        err_sys( "Couldn't create a socket towards the server" ) ;
+    if ( connect( s->sd , (SA *) &server , sizeof(server) ) < 0 )
+        err_sys( "Couldn't connect to the server" ) ;
+    s->client   = *client ;
+    s->inFlight = 0 ;
+    return freeSlot ;
+}
+
+/*--------------------------------------------------------------------
+   Put one copy of a datagram on the wheel, due after the link's queue,
+   the delay, the jitter and, if it is to be reordered, a bit more
+----------------------------------------------------------------------*/
+void enqueue( int session , int dir , const char *data , size_t len , tick_t now , int reorder )
+{
+    link_t   *link = &links[ dir ] ;
+    packet_t *p    = malloc( sizeof(packet_t) + len ) ;
+    if ( p == NULL )
+        err_sys( "Couldn't allocate a datagram" ) ;
+
+    memset( &p->tmr , 0 , sizeof(p->tmr) ) ;
+    p->session = session ;
+    p->dir     = dir ;
+    p->len     = len ;
+    memcpy( p->data , data , len ) ;
+
+    // Serialization on a link of 'kbps': 1 kbit/s is 1 bit per ms
+    tick_t sent = now ;
+    if ( kbps > 0 ) {
+        if ( link->freeAt < now )
+            link->freeAt = now ;
+        link->freeAt += ( len * 8 + kbps - 1 ) / kbps ;
+        sent = link->freeAt ;
+    }
+
+    long delay = delayMS ;
+    if ( jitterMS > 0 )
+        delay += random() % ( jitterMS + 1 ) ;
+    if ( reorder ) {
+        delay += reorderMS >= 0 ? reorderMS : 2 * ( delayMS + jitterMS ) + 10 ;
+        link->reordered++ ;
+    }
+
+    p->tmr.fire = NULL ;
+    wheelAdd( &wheel , &p->tmr , sent + delay ) ;
+    sessions[ session ].inFlight++ ;
+}
+
+/*--------------------------------------------------------------------
+   A datagram arrived from a client (UPSTREAM) or the server
+----------------------------------------------------------------------*/
+void arrive( int session , int dir , const char *data , size_t len , tick_t now )
+{
+    link_t *link = &links[ dir ] ;
+
+    link->received++ ;
+    sessions[ session ].lastUsed = now ;
+
+    if ( chance( lossPct ) ) {
+        link->dropped++ ;
+        return ;
+    }
+    enqueue( session , dir , data , len , now , chance( reorderPct ) ) ;
+    if ( chance( dupPct ) ) {
+        link->duplicated++ ;
+        enqueue( session , dir , data , len , now , 0 ) ;
+    }
+}
+
+/*--------------------------------------------------------------------
+   Send what is due
+----------------------------------------------------------------------*/
+void deliver( tick_t now )
+{
+    wheelTimer *list = wheelAdvance( &wheel , now ) ;
+
+    while ( list ) {
+        packet_t  *p = (packet_t *) list ;
+        session_t *s = &sessions[ p->session ] ;
+        ssize_t    n ;
+        list = list->next ;
+
+        if ( p->dir == UPSTREAM )
+            n = send( s->sd , p->data , p->len , 0 ) ;
+        else
+            n = sendto( lsd , p->data , p->len , 0 , (SA *) &s->client , sizeof(s->client) ) ;
+        if ( n < 0 && errno != ECONNREFUSED )
+            perror( "Error forwarding a datagram" ) ;
+        else if ( n >= 0 )
+            links[ p->dir ].forwarded++ ;
+
+        s->inFlight-- ;
+        free( p ) ;
+    }
+}
+
+//------------------
+
+void printLink( const char *name , link_t *l )
+{
+    printf( "%-22s: %lu received , %lu forwarded , %lu dropped , %lu duplicated , %lu reordered\n"
+            , name , l->received , l->forwarded , l->dropped , l->duplicated , l->reordered ) ;
+}
+
+/*-------------------------------------------------------*/
+int main( int argc , char *argv[] )
+{
+    int     opt ;
+    long    seed = time( NULL ) ^ getpid() ;
+
+    while ( ( opt = getopt( argc , argv , "l:d:r:R:D:j:b:s:" ) ) != -1 )
+    {
+        switch ( opt ) {
+          case 'l':  lossPct    = atof( optarg ) ;  break ;
+          case 'd':  dupPct     = atof( optarg ) ;  break ;
+          case 'r':  reorderPct = atof( optarg ) ;  break ;
+          case 'R':  reorderMS  = atol( optarg ) ;  break ;
+          case 'D':  delayMS    = atol( optarg ) ;  break ;
+          case 'j':  jitterMS   = atol( optarg ) ;  break ;
+          case 'b':  kbps       = atol( optarg ) ;  break ;
+          case 's':  seed       = atol( optarg ) ;  break ;
+          default:
+            argc = 0 ;
+            break ;
+        }
+    }
+    if ( argc - optind != 3 )
+    {
+        printf( "IMPAIR Usage: %s [-l loss%%] [-d dup%%] [-r reorder%%] [-R reorderMS] [-D delayMS]\n"
+                "              [-j jitterMS] [-b kbit/s] [-s seed] <listenPort> <FactoryServerIP> <port>\n"
+                , argv[0] ) ;
+        exit( 1 ) ;
+    }
+    srandom( (unsigned) seed ) ;
+
+    unsigned short listenPort = atoi( argv[optind] ) ;
+    memset( (void *) &server , 0 , sizeof(server) ) ;
+    server.sin_family = AF_INET ;
+    server.sin_port   = htons( atoi( argv[optind+2] ) ) ;
+    if ( inet_pton( AF_INET , argv[optind+1] , (void *) &server.sin_addr.s_addr ) != 1 )
+        err_quit( "Invalid server IP address\n" ) ;
+
+    struct sockaddr_in me ;
+    memset( (void *) &me , 0 , sizeof(me) ) ;
+    me.sin_family      = AF_INET ;
+    me.sin_port        = htons( listenPort ) ;
+    me.sin_addr.s_addr = htonl( INADDR_ANY ) ;
+    lsd = socket( AF_INET , SOCK_DGRAM , 0 ) ;
+    if ( lsd < 0 )
+        err_sys( "Couldn't create a UDP socket" ) ;
+    if ( bind( lsd , (SA *) &me , sizeof(me) ) < 0 )
+        err_sys( "Couldn't bind the listening socket" ) ;
+
+    for ( int i = 0 ; i < MAXSESSIONS ; i++ )
+        sessions[i].sd = -1 ;
+    wheelInit( &wheel , wheelClock() ) ;
+    sigactionWrapper( SIGINT , stop ) ;
+    sigactionWrapper( SIGTERM , stop ) ;
+
+    printf( "IMPAIR: port %hu -> %s:%s , loss %.1f%% , dup %.1f%% , reorder %.1f%% , "
+            "delay %ld+%ld ms , %s%ld kbit/s\n"
+            , listenPort , argv[optind+1] , argv[optind+2] , lossPct , dupPct , reorderPct
+            , delayMS , jitterMS , kbps ? "" : "unlimited " , kbps ) ;
+    fflush( stdout ) ;
+
+    struct pollfd pfd[ 1 + MAXSESSIONS ] ;
+    int           who[ 1 + MAXSESSIONS ] ;
+    char          buf[ MAXDGRAM ] ;
+
+    while ( !done )
+    {
+        int nfds = 0 ;
+        pfd[ nfds ] = (struct pollfd) { .fd = lsd , .events = POLLIN } ;
+        who[ nfds++ ] = -1 ;
+        for ( int i = 0 ; i < MAXSESSIONS ; i++ ) {
+            if ( sessions[i].sd < 0 )
+                continue ;
+            pfd[ nfds ] = (struct pollfd) { .fd = sessions[i].sd , .events = POLLIN } ;
+            who[ nfds++ ] = i ;
+        }
+
+        if ( poll( pfd , nfds , (int) wheelTimeout( &wheel ) ) < 0 ) {
+            if ( errno == EINTR )
+                continue ;
+            err_sys( "Error waiting for datagrams" ) ;
+        }
+
+        tick_t now = wheelClock() ;
+        for ( int k = 0 ; k < nfds ; k++ ) {
+            if ( !( pfd[k].revents & ( POLLIN | POLLERR ) ) )
+                continue ;
+
+            if ( who[k] < 0 ) {
+                struct sockaddr_in from ;
+                socklen_t          alen = sizeof(from) ;
+                ssize_t n = recvfrom( lsd , buf , sizeof(buf) , 0 , (SA *) &from , &alen ) ;
+                if ( n < 0 )
+                    continue ;
+                int s = findSession( &from , now ) ;
+                if ( s < 0 ) {
+                    links[ UPSTREAM ].dropped++ ;
+                    continue ;
+                }
+                arrive( s , UPSTREAM , buf , n , now ) ;
+            }
+            else {
+                ssize_t n = recv( pfd[k].fd , buf , sizeof(buf) , 0 ) ;
+                if ( n < 0 )
+                    continue ;      // e.g. the server is not up (ECONNREFUSED)
+                arrive( who[k] , DOWNSTREAM , buf , n , now ) ;
+            }
+        }
+
+        deliver( wheelClock() ) ;
+    }
+
+    printf( "\nIMPAIR: done\n" ) ;
+    printLink( "Client -> server" , &links[ UPSTREAM ] ) ;
+    printLink( "Server -> client" , &links[ DOWNSTREAM ] ) ;
+    return 0 ;
+}
@@ -16,27 +16,44 @@ void printMsg( msgBuf *m )
     switch ( ntohl( m->purpose ) )
     {
        case PRODUCTION_MSG :
-            printf( "{ PRODUCTION ,FacID=%-3d, Capacity=%-3d, Made=%-4d, duration=%-4dms) }"
+            printf( "{ PRODUCTION ,FacID=%-3d, Capacity=%-3d, Made=%-4d, duration=%-4dms), seq=%u }"
                    , ntohl(m->facID) , ntohl(m->capacity) 
-                   , ntohl(m->partsMade) , ntohl(m->duration) ) ;
+                   , ntohl(m->partsMade) , ntohl(m->duration) , ntohl(m->seqNum) ) ;
             break ;
     
         case COMPLETION_MSG :
-            printf( "{ COMPLETION , FacID=%-3d }" , ntohl(m->facID) ) ;
+            printf( "{ COMPLETION , FacID=%-3d, seq=%u }" , ntohl(m->facID) , ntohl(m->seqNum) ) ;
             break ;
 
         case REQUEST_MSG :
-            printf( "{ REQUEST    , OrderSz=%-3d }" , ntohl(m->orderSize) ) ;
+            if ( m->orderID )
+                printf( "{ REQUEST    , OrderSz=%-3d, OrderID=%08x }" , ntohl(m->orderSize) , ntohl(m->orderID) ) ;
+            else
+                printf( "{ REQUEST    , OrderSz=%-3d }" , ntohl(m->orderSize) ) ;
             break ;
 
         case ORDR_CONFIRM :
-            printf( "{ ORDR_CNFRM , numFacThrds=%-3d }" , ntohl(m->numFac) ) ;
+            printf( "{ ORDR_CNFRM , numFacThrds=%-3d, Capacity=%-4d/sec }" 
+                   , ntohl(m->numFac) , ntohl(m->capacity) ) ;
             break ;
 
         case PROTOCOL_ERR :
             printf( "{ PROTOCOL_ERROR }" ) ;
             break ;
 
+        case CANCEL_MSG :
+            printf( "{ CANCEL     }" ) ;
+            break ;
+
+        case KEEPALIVE_MSG :
+            printf( "{ KEEPALIVE  }" ) ;
+            break ;
+
+        case SUMMARY_MSG :
+            printf( "{ SUMMARY    , made %5d of %5d parts in %5d mSecs }"
+                    , ntohl(m->partsMade) , ntohl(m->orderSize) , ntohl(m->duration) ) ;
+            break ;
+
         default :
             printf( "{ UNDEFINED_MSG }" ) ;
             break ;
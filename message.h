@@ -12,19 +12,28 @@
 
 typedef enum 
 {
-    PRODUCTION_MSG = 1 , COMPLETION_MSG , REQUEST_MSG , ORDR_CONFIRM , PROTOCOL_ERR 
+    PRODUCTION_MSG = 1 , COMPLETION_MSG , REQUEST_MSG , ORDR_CONFIRM , PROTOCOL_ERR ,
+    CANCEL_MSG ,        /* client no longer wants the rest of its order */
+    KEEPALIVE_MSG ,     /* client is still waiting for its order */
+    SUMMARY_MSG         /* order is over: partsMade of orderSize in 'duration' ms */
 } msgPurpose_t;
 
 typedef struct {
 
     int       purpose ;  /* Purpose of this message to Supervisor */
 
-    unsigned  orderSize ,      /* Initial requested order size */
+    unsigned  orderSize ,      /* Initial requested order size (0 = capacity query) */
               numFac    ,      /* number of Factory Threads serving the client */
               facID     ,      /* sender's Factory ID */
-              capacity  ,      /* #of parts made in most recent iteration */
+              capacity  ,      /* sender's capacity: parts per iteration, or
+                                  parts/sec of the whole server in ORDR_CONFIRM */
               partsMade ,      /* #of parts made in most recent iteration */
-              duration  ;      /* how long it took to make them */
+              duration  ,      /* how long it took to make them */
+              seqNum    ,      /* per-order sequence number of factory messages */
+              sentSec   ,      /* when the factory sent it (gettimeofday) */
+              sentUsec  ,
+              orderID   ;      /* client's ID of the order, the same on every
+                                  retry of its request (0 = none) */
 
 } msgBuf ;
 
@@ -0,0 +1,295 @@
+//---------------------------------------------------------------------
+// Assignment : PA-04 Threads - UDP
+// Date       : 12/1/2025
+// Author     : Kyle Mirra      Akwasi Okyere
+// File Name  : metrics.c
+//---------------------------------------------------------------------
+
+#include <sys/types.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "wrappers.h"
+#include "metrics.h"
+
+#define GET( x )        __atomic_load_n( &(x) , __ATOMIC_RELAXED )
+#define PUT( x , v )    __atomic_store_n( &(x) , (v) , __ATOMIC_RELAXED )
+
+/*--------------------------------------------------------------------
+   Microseconds on the monotonic clock, shared by all processes
+----------------------------------------------------------------------*/
+unsigned long long metricsClock( void )
+{
+    struct timespec ts ;
+    clock_gettime( CLOCK_MONOTONIC , &ts ) ;
+    return (unsigned long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000 ;
+}
+
+/*--------------------------------------------------------------------
+   Seqlock, writer side: claim the counter by making it odd
+----------------------------------------------------------------------*/
+static void writeBegin( unsigned *seq )
+{
+    unsigned s ;
+    do {
+        s = __atomic_load_n( seq , __ATOMIC_RELAXED ) ;
+    } while ( ( s & 1 )
+              || !__atomic_compare_exchange_n( seq , &s , s + 1 , 0 ,
+                                               __ATOMIC_ACQUIRE , __ATOMIC_RELAXED ) ) ;
+}
+
+//------------------
+
+static void writeEnd( unsigned *seq )
+{
+    __atomic_fetch_add( seq , 1 , __ATOMIC_RELEASE ) ;
+}
+
+//------------------
+
+static size_t blockSize( unsigned numLines )
+{
+    return sizeof( metricsBlock ) + numLines * sizeof( lineMetrics ) ;
+}
+
+/*--------------------------------------------------------------------
+   Set up the segment for a server with 'numLines' sub-factories. With
+   'keep' (a hot upgrade) the counters of a matching segment carry on;
+   a segment that does not match is left to the draining server and a
+   new one takes over the key. Otherwise the counters start from zero
+   (no other server can be writing then: the port was free). A segment
+   of another size is replaced. Returns NULL, after saying why, if
+   shared memory is not available: the server runs without metrics then.
+----------------------------------------------------------------------*/
+metricsBlock *metricsCreate( unsigned short port , unsigned numLines , unsigned workers , int keep )
+{
+    key_t   key  = METRICS_KEY( port ) ;
+    size_t  size = blockSize( numLines ) ;
+    int     shmid ;
+
+    shmid = shmget( key , size , IPC_CREAT | 0644 ) ;
+    if ( shmid < 0 && errno == EINVAL ) {
+        // Left by a server with a different number of sub-factories
+        int old = shmget( key , 0 , 0 ) ;
+        if ( old >= 0 )
+            shmctl( old , IPC_RMID , NULL ) ;
+        keep  = 0 ;
+        shmid = shmget( key , size , IPC_CREAT | 0644 ) ;
+    }
+    if ( shmid < 0 ) {
+        perror( "Couldn't create the shared memory metrics, running without" ) ;
+        return NULL ;
+    }
+
+    metricsBlock *m = Shmat( shmid , NULL , 0 ) ;
+
+    if ( keep && ( m->magic != METRICS_MAGIC || m->version != METRICS_VERSION
+                   || m->numLines != numLines ) )
+    {
+        // The server we take over from is still writing to it: leave it to
+        // that one and start a segment of our own under the key
+        shmdt( m ) ;
+        shmctl( shmid , IPC_RMID , NULL ) ;
+        keep  = 0 ;
+        shmid = shmget( key , size , IPC_CREAT | IPC_EXCL | 0644 ) ;
+        if ( shmid < 0 ) {
+            perror( "Couldn't create the shared memory metrics, running without" ) ;
+            return NULL ;
+        }
+        m = Shmat( shmid , NULL , 0 ) ;
+    }
+
+    if ( !keep )
+    {
+        unsigned long long now = metricsClock() ;
+
+        // No other writer can be using it, but one that was killed in
+        // the middle of an update may have left the counter odd, and
+        // writeBegin() would wait for it forever
+        __atomic_store_n( &m->seq , 1 , __ATOMIC_RELAXED ) ;
+        __atomic_thread_fence( __ATOMIC_RELEASE ) ;
+        m->magic    = 0 ;           // readers: not ready yet
+        m->numLines = numLines ;
+        m->workers  = workers ;
+        m->startUs  = now ;
+        m->activeOrders = 0 ;
+        m->ordersServed = m->queueDepth = m->sendErrors = 0 ;
+        for ( unsigned i = 0 ; i < numLines ; i++ ) {
+            memset( (void *) &m->line[i] , 0 , sizeof( lineMetrics ) ) ;
+            m->line[i].sinceUs = now ;
+        }
+        m->version  = METRICS_VERSION ;
+        m->magic    = METRICS_MAGIC ;
+        m->pid      = getpid() ;
+        writeEnd( &m->seq ) ;
+    }
+    else {
+        writeBegin( &m->seq ) ;
+        m->workers = workers ;
+        PUT( m->pid , getpid() ) ;
+        writeEnd( &m->seq ) ;
+    }
+    return m ;
+}
+
+/*--------------------------------------------------------------------
+   The server is going away. With 'remove' nobody takes over: mark the
+   segment as orphaned and have it destroyed once readers detach.
+----------------------------------------------------------------------*/
+void metricsRelease( metricsBlock *m , unsigned short port , int remove )
+{
+    if ( m == NULL )
+        return ;
+
+    if ( remove ) {
+        writeBegin( &m->seq ) ;
+        PUT( m->pid , 0 ) ;
+        writeEnd( &m->seq ) ;
+
+        int shmid = shmget( METRICS_KEY( port ) , 0 , 0 ) ;
+        if ( shmid >= 0 )
+            shmctl( shmid , IPC_RMID , NULL ) ;
+    }
+    shmdt( m ) ;
+}
+
+/*--------------------------------------------------------------------
+   Sub-factory 'facID' starts (+1) or stops (-1) working on an order.
+   The time since its last change is busy or idle time.
+----------------------------------------------------------------------*/
+void metricsLineRun( metricsBlock *m , unsigned facID , int delta )
+{
+    if ( m == NULL || facID < 1 || facID > m->numLines )
+        return ;
+
+    lineMetrics        *l   = &m->line[ facID - 1 ] ;
+    unsigned long long  now = metricsClock() ;
+
+    writeBegin( &l->seq ) ;
+    unsigned long long spent = now > l->sinceUs ? now - l->sinceUs : 0 ;
+    if ( l->running > 0 )
+        PUT( l->busyUs , l->busyUs + spent ) ;
+    else
+        PUT( l->idleUs , l->idleUs + spent ) ;
+    PUT( l->sinceUs , now ) ;
+    PUT( l->running , l->running + delta ) ;
+    writeEnd( &l->seq ) ;
+}
+
+//------------------
+
+void metricsLineIter( metricsBlock *m , unsigned facID , unsigned parts )
+{
+    if ( m == NULL || facID < 1 || facID > m->numLines )
+        return ;
+
+    lineMetrics *l = &m->line[ facID - 1 ] ;
+
+    writeBegin( &l->seq ) ;
+    PUT( l->parts , l->parts + parts ) ;
+    PUT( l->iters , l->iters + 1 ) ;
+    writeEnd( &l->seq ) ;
+}
+
+/*--------------------------------------------------------------------
+   Orders started / finished and parts queued / taken off the queue
+----------------------------------------------------------------------*/
+void metricsOrders( metricsBlock *m , int active , int served , long long queued )
+{
+    if ( m == NULL )
+        return ;
+
+    writeBegin( &m->seq ) ;
+    PUT( m->activeOrders , m->activeOrders + active ) ;
+    PUT( m->ordersServed , m->ordersServed + served ) ;
+    PUT( m->queueDepth   , m->queueDepth + queued ) ;
+    writeEnd( &m->seq ) ;
+}
+
+//------------------
+
+void metricsSendError( metricsBlock *m )
+{
+    if ( m == NULL )
+        return ;
+
+    writeBegin( &m->seq ) ;
+    PUT( m->sendErrors , m->sendErrors + 1 ) ;
+    writeEnd( &m->seq ) ;
+}
+
+/*--------------------------------------------------------------------
+   Reader side: attach read-only to the segment of the server on 'port'
+----------------------------------------------------------------------*/
+metricsBlock *metricsOpen( unsigned short port )
+{
+    int           shmid = Shmget( METRICS_KEY( port ) , 0 , 0 ) ;
+    metricsBlock *m     = Shmat( shmid , NULL , SHM_RDONLY ) ;
+
+    if ( GET( m->magic ) != METRICS_MAGIC || GET( m->version ) != METRICS_VERSION )
+        err_quit( "Not a FACTORY metrics segment of a version this tool knows\n" ) ;
+    return m ;
+}
+
+/*--------------------------------------------------------------------
+   Consistent copies of the header and of line 'i'. Return how many
+   times the copy had to be retried because a writer was busy.
+----------------------------------------------------------------------*/
+unsigned metricsReadHdr( const metricsBlock *m , metricsBlock *out )
+{
+    unsigned s , retries = 0 ;
+
+    while ( 1 ) {
+        s = __atomic_load_n( &m->seq , __ATOMIC_ACQUIRE ) ;
+        if ( !( s & 1 ) ) {
+            out->magic        = GET( m->magic ) ;
+            out->version      = GET( m->version ) ;
+            out->numLines     = GET( m->numLines ) ;
+            out->workers      = GET( m->workers ) ;
+            out->startUs      = GET( m->startUs ) ;
+            out->pid          = GET( m->pid ) ;
+            out->activeOrders = GET( m->activeOrders ) ;
+            out->ordersServed = GET( m->ordersServed ) ;
+            out->queueDepth   = GET( m->queueDepth ) ;
+            out->sendErrors   = GET( m->sendErrors ) ;
+            __atomic_thread_fence( __ATOMIC_ACQUIRE ) ;
+            if ( __atomic_load_n( &m->seq , __ATOMIC_RELAXED ) == s )
+                break ;
+        }
+        retries++ ;
+    }
+    out->seq = s ;
+    return retries ;
+}
+
+//------------------
+
+unsigned metricsReadLine( const metricsBlock *m , unsigned i , lineMetrics *out )
+{
+    const lineMetrics *l = &m->line[i] ;
+    unsigned           s , retries = 0 ;
+
+    while ( 1 ) {
+        s = __atomic_load_n( &l->seq , __ATOMIC_ACQUIRE ) ;
+        if ( !( s & 1 ) ) {
+            out->running = GET( l->running ) ;
+            out->parts   = GET( l->parts ) ;
+            out->iters   = GET( l->iters ) ;
+            out->busyUs  = GET( l->busyUs ) ;
+            out->idleUs  = GET( l->idleUs ) ;
+            out->sinceUs = GET( l->sinceUs ) ;
+            __atomic_thread_fence( __ATOMIC_ACQUIRE ) ;
+            if ( __atomic_load_n( &l->seq , __ATOMIC_RELAXED ) == s )
+                break ;
+        }
+        retries++ ;
+    }
+    out->seq = s ;
+    return retries ;
+}
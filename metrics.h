@@ -0,0 +1,77 @@
+//---------------------------------------------------------------------
+// Assignment : PA-04 Threads - UDP
+// Date       : 12/1/2025
+// Author     : Kyle Mirra      Akwasi Okyere
+// File Name  : metrics.h
+//---------------------------------------------------------------------
+
+#ifndef  METRICS_H
+#define  METRICS_H
+
+#include <sys/types.h>
+
+/*--------------------------------------------------------------------
+   Live FACTORY metrics in a System V shared memory segment, keyed by
+   the server's port, so that factory-top can watch a server without
+   asking it anything.
+
+   The segment is a header followed by one cache line per sub-factory.
+   The header and every line have their own sequence counter (seqlock):
+   a writer makes it odd, updates the fields and makes it even again; a
+   reader copies the fields and retries if the counter was odd or has
+   moved meanwhile. Writers never wait for readers and do no system
+   calls (the monotonic clock is read through the vDSO). Two writers of
+   the same line, e.g. two orders, take turns on the counter.
+
+   A hot-upgraded server re-attaches the segment of the server it
+   replaces and keeps its counters going.
+----------------------------------------------------------------------*/
+#define METRICS_MAGIC      0x4D455452      // "METR"
+#define METRICS_VERSION    1
+
+#define METRICS_KEY( port )   ( (key_t) ( 0x46410000 | (port) ) )     // "FA" + port
+
+typedef struct {
+    unsigned            seq ;
+    unsigned            running ;          // orders this sub-factory works on now
+    unsigned long long  parts ,            // parts made
+                        iters ,            // production iterations
+                        busyUs ,           // time with 'running' > 0 ...
+                        idleUs ,           // ... and with 'running' == 0,
+                        sinceUs ;          //     both up to this time
+} __attribute__(( aligned( 64 ) )) lineMetrics ;
+
+typedef struct {
+    // Fixed when the segment is set up
+    unsigned            magic , version ;
+    unsigned            numLines ;         // lineMetrics that follow
+    unsigned            workers ;          // wheel worker threads, 0 = thread per line
+    unsigned long long  startUs ;          // monotonic time the counters started
+
+    // Protected by 'seq'
+    unsigned            seq ;
+    pid_t               pid ;              // server updating the segment, 0 if none
+    unsigned            activeOrders ;
+    unsigned long long  ordersServed ,
+                        queueDepth ,       // parts accepted but not yet started
+                        sendErrors ;
+
+    lineMetrics         line[] ;
+} metricsBlock ;
+
+unsigned long long  metricsClock ( void ) ;
+
+// Server side
+metricsBlock *metricsCreate ( unsigned short port , unsigned numLines , unsigned workers , int keep ) ;
+void          metricsRelease( metricsBlock *m , unsigned short port , int remove ) ;
+void          metricsLineRun( metricsBlock *m , unsigned facID , int delta ) ;
+void          metricsLineIter( metricsBlock *m , unsigned facID , unsigned parts ) ;
+void          metricsOrders ( metricsBlock *m , int active , int served , long long queued ) ;
+void          metricsSendError( metricsBlock *m ) ;
+
+// Reader side
+metricsBlock *metricsOpen   ( unsigned short port ) ;
+unsigned      metricsReadHdr ( const metricsBlock *m , metricsBlock *out ) ;
+unsigned      metricsReadLine( const metricsBlock *m , unsigned i , lineMetrics *out ) ;
+
+#endif
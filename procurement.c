@@ -17,144 +17,987 @@
 #include <stdlib.h>
 #include <signal.h>
 #include <time.h>
+#include <poll.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
 
 #include "wrappers.h"
 #include "message.h"
+#include "stats.h"
 
-#define MAXFACTORIES    20
+#define IPSTRLEN            50
+#define RETRY_BASE_MS       200    // first wait for an ORDR_CONFIRM, doubled per retry
+#define RETRY_MAX_MS        2000   // ... up to this
+#define MAX_RETRIES         4      // re-sends of a request before giving up on the server
+#define HEDGE_DEFAULT_MS    100    // hedge delay until handshake times have been seen
+#define HEDGE_FLOOR_MS      20     // never hedge sooner than this
+#define CANCEL_LINGER_MS    2000   // keep re-cancelling a hedged-out leg until quiet this long
+#define KEEPALIVE_MS        1000   // tell the servers of running legs we are still here
+#define STALL_MS            3000   // silence after which a running leg is given up
+#define SLOW_WARMUP_MS      3000   // don't judge a leg's speed before this
+#define SLOW_FRACTION       0.5    // slow = made less than this share of what it advertised
+#define TICK_MS             100    // housekeeping period of the monitor loop
+#define RCVBUF_BYTES        ( 8 << 20 )
+#define SEQ_WINDOW          256    // report sequence numbers remembered per leg
+#define SEQ_WORDS           ( SEQ_WINDOW / 64 )
 
 typedef struct sockaddr SA ;
 
+// One Factory server taking part in the order
+typedef struct {
+    char               name[ IPSTRLEN + 8 ] ;  // "IP:port" for the reports
+    struct sockaddr_in addr ;
+    unsigned           numFac ,     // sub-factories, from the capacity query
+                       capacity ;   // parts per second, from the capacity query
+    int                alive ,      // still trusted with work
+                       busyLegs ;   // legs not yet finished on this server
+    facStats           stats ;      // production of all legs sent to this server
+} endpoint_t ;
+
+// One order sent to one server. Every leg has its own socket, so the
+// messages of a leg are exactly the datagrams arriving on that socket.
+// A leg whose sub-factories have all COMPLETED is COMPLETING until the
+// server's SUMMARY_MSG gives the final count of the parts it made.
+typedef enum { LEG_WAIT_CONFIRM , LEG_RUNNING , LEG_COMPLETING , LEG_DONE ,
+               LEG_ABANDONED , LEG_CANCELLED } legState_t ;
+
+typedef struct {
+    int             sd ;
+    endpoint_t     *ep ;
+    legState_t      state ;
+    unsigned        orderID ,       // ours, the same on every re-send of the request
+                    share ,         // parts ordered on this leg
+                    made ;          // parts reported so far
+    int             activeLines ;   // sub-factories that have not COMPLETED yet
+    struct timeval  sentTime ,      // when the request was sent
+                    confirmTime ,   // when the ORDR_CONFIRM arrived
+                    lastHeard ;     // most recent datagram on this leg
+
+    // Latency bookkeeping, all in microseconds
+    unsigned long long  confirmSentUs , // factory's send time of ORDR_CONFIRM
+                        lastSentUs ,    // factory's send time of the previous report
+                        lastArrUs ;     // our receive time of the previous report
+    unsigned            expectSeq ;     // next report sequence number
+    unsigned long long  seqSeen[ SEQ_WORDS ] ;  // reports seen below it, bit 0 = expectSeq-1
+
+    // Order placement: retries and hedging
+    int                 attempts ,      // re-sends of the request so far
+                        twin ,          // index of the leg racing this one, or -1
+                        isHedge ,       // this leg is the hedge of another
+                        hedgeTried ;    // a hedge was considered for this leg
+    unsigned long long  firstSentUs ,   // first send of the request
+                        retryAtUs ,     // when to re-send it (COMPLETING: to
+                                        // ask for the summary again)
+                        lingerUntilUs , // cancelled leg: when to stop listening
+                        lastCancelUs ,  // cancelled leg: last CANCEL_MSG sent
+                        lastKeepaliveUs ;
+} leg_t ;
+
+char  *myName = "Kyle Mirra and Akwasi Okyere" ;
+
+endpoint_t *eps ;    int numEps ;
+leg_t      *legs ;   int numLegs , maxLegs ;
+unsigned    unassigned ;    // parts taken back from abandoned legs, not yet re-ordered
+unsigned    lastOrderID ;   // order IDs are handed out from here
+
+int         hedged ;        // -h: race a slow order placement against another server
+latHist     handshake ;     // request -> ORDR_CONFIRM times (us), first attempts only
+unsigned    retries , hedges , hedgesWon , hedgeWaste ;
+
+volatile sig_atomic_t interrupted ;   // Ctrl-C: cancel what is still running
+
 /*-------------------------------------------------------*/
-int main( int argc , char *argv[] )
+long msSince( struct timeval *then )
 {
-    int     numFactories ,      // Total Number of Factory Threads
-            activeFactories ,   // How many are still alive and manufacturing parts
-            iters[ MAXFACTORIES+1 ] = {0} ,  // num Iterations completed by each Factory
-            partsMade[ MAXFACTORIES+1 ] = {0} , totalItems = 0;
+    struct timeval now ;
+    gettimeofday( &now , NULL ) ;
+    return (now.tv_sec - then->tv_sec) * 1000L + (now.tv_usec - then->tv_usec) / 1000L ;
+}
 
-    struct timeval startTime, endTime; // starting and ending time
-    long elapsedMS; // total time taken
+/*-------------------------------------------------------*/
+unsigned long long nowUs( void )
+{
+    struct timeval now ;
+    gettimeofday( &now , NULL ) ;
+    return (unsigned long long) now.tv_sec * 1000000 + now.tv_usec ;
+}
 
-    socklen_t addrLen;
+/*--------------------------------------------------------------------
+   Age the window of seen sequence numbers by 'n'
+----------------------------------------------------------------------*/
+void seqShift( unsigned long long *w , unsigned n )
+{
+    unsigned words = n / 64 , bits = n % 64 ;
 
-    char  *myName = "Kyle Mirra and Akwasi Okyere" ; 
-    printf("\nThis is procurement. ( by %s )\n\n", myName);
-    fflush( stdout ) ;
-    
-    if ( argc < 4 )
-    {
-        printf("PROCUREMENT Usage: %s  <order_size> <FactoryServerIP>  <port>\n" , argv[0] );
-        exit( -1 ) ;  
+    for ( int i = SEQ_WORDS - 1 ; i >= 0 ; i-- ) {
+        unsigned long long v = 0 ;
+        if ( i >= (int) words ) {
+            v = w[ i - words ] << bits ;
+            if ( bits && i > (int) words )
+                v |= w[ i - words - 1 ] >> ( 64 - bits ) ;
+        }
+        w[i] = v ;
     }
+}
 
-    unsigned        orderSize  = atoi( argv[1] ) ;
-    char	       *serverIP   = argv[2] ;
-    unsigned short  port       = (unsigned short) atoi( argv[3] ) ;
- 
+/*--------------------------------------------------------------------
+   Sequence gaps and duplicates. A report that was seen before returns
+   0 and must not be counted again; anything else returns 1. Reports
+   older than the window cannot be told apart and are taken as late.
+----------------------------------------------------------------------*/
+int noteSeq( leg_t *leg , unsigned seq )
+{
+    facStats *st = &leg->ep->stats ;
+
+    if ( seq >= leg->expectSeq ) {
+        unsigned ahead = seq - leg->expectSeq + 1 ;
+        st->lost += ahead - 1 ;
+        if ( ahead >= SEQ_WINDOW )
+            memset( leg->seqSeen , 0 , sizeof(leg->seqSeen) ) ;
+        else
+            seqShift( leg->seqSeen , ahead ) ;
+        leg->seqSeen[0] |= 1 ;
+        leg->expectSeq   = seq + 1 ;
+        return 1 ;
+    }
 
-    /* Set up local and remote sockets */
+    unsigned back = leg->expectSeq - 1 - seq ;
+    if ( back < SEQ_WINDOW ) {
+        unsigned long long bit = 1ull << ( back % 64 ) ;
+        if ( leg->seqSeen[ back / 64 ] & bit ) {
+            st->duplicates++ ;
+            return 0 ;
+        }
+        leg->seqSeen[ back / 64 ] |= bit ;
+    }
+    st->reordered++ ;         // late: it was counted as missing
+    if ( st->lost > 0 )
+        st->lost-- ;
+    return 1 ;
+}
+
+/*--------------------------------------------------------------------
+   Transit time and inter-arrival jitter of one report.
+   Jitter is how much the gap between two arrivals differs from the gap
+   between their sends, so it is immune to clock offset; transit time
+   needs the two clocks to agree (it is exact on one host).
+----------------------------------------------------------------------*/
+void noteTiming( leg_t *leg , msgBuf *m , unsigned long long arrUs )
+{
+    facStats          *st     = &leg->ep->stats ;
+    unsigned long long sentUs = (unsigned long long) ntohl(m->sentSec) * 1000000 + ntohl(m->sentUsec) ;
+
+    histAdd( &st->transit , arrUs > sentUs ? arrUs - sentUs : 0 ) ;
+
+    long long d = (long long) ( arrUs - leg->lastArrUs ) - (long long) ( sentUs - leg->lastSentUs ) ;
+    histAdd( &st->jitter , d < 0 ? -d : d ) ;
+    leg->lastArrUs  = arrUs ;
+    leg->lastSentUs = sentUs ;
+
+    if ( ntohl(m->purpose) == PRODUCTION_MSG )
+        statsTiming( st , ntohl(m->facID) , sentUs , leg->confirmSentUs ) ;
+}
+
+/*-------------------------------------------------------*/
+int newSocket( void )
+{
     int sd = socket(AF_INET, SOCK_DGRAM, 0);
     if (sd < 0) {
         err_sys("Error creating socket");
     }
 
-    // Prepare the server's socket address structure
-    struct sockaddr_in srvrSkt;
-    memset((void *) &srvrSkt, 0, sizeof(srvrSkt));
-    srvrSkt.sin_family = AF_INET;
-    srvrSkt.sin_port = htons(port);
-    if (inet_pton(AF_INET, serverIP, (void *) &srvrSkt.sin_addr.s_addr) != 1) {
-        err_sys("Invalid IP Address");
-    }
+    // A server with thousands of sub-factories reports in bursts; give
+    // the burst room to queue (the kernel caps this at net.core.rmem_max)
+    int rcvBuf = RCVBUF_BYTES ;
+    setsockopt( sd , SOL_SOCKET , SO_RCVBUF , &rcvBuf , sizeof(rcvBuf) ) ;
+    return sd ;
+}
 
-    // Send the initial request to the Factory Server
+/*--------------------------------------------------------------------
+   How long to wait before re-sending a request for the 'attempt'-th
+   time: exponential, capped, and jittered between half and all of it
+   so that many clients do not retry in lock-step
+----------------------------------------------------------------------*/
+long backoffMS( int attempt )
+{
+    long wait = RETRY_BASE_MS ;
+    while ( attempt-- > 0 && wait < RETRY_MAX_MS )
+        wait *= 2 ;
+    if ( wait > RETRY_MAX_MS )
+        wait = RETRY_MAX_MS ;
+    return wait / 2 + random() % ( wait / 2 + 1 ) ;
+}
+
+//------------------
+
+unsigned long long hedgeDelayUs( void )
+{
+    if ( handshake.count == 0 )
+        return HEDGE_DEFAULT_MS * 1000ull ;
+
+    unsigned long long p95 = histPercentile( &handshake , 95 ) ;
+    return p95 > HEDGE_FLOOR_MS * 1000ull ? p95 : HEDGE_FLOOR_MS * 1000ull ;
+}
+
+/*-------------------------------------------------------*/
+void sendRequest( int sd , endpoint_t *ep , unsigned orderSize , unsigned orderID )
+{
     msgBuf  msg1;
+    memset( &msg1 , 0 , sizeof(msg1) ) ;
     msg1.orderSize = htonl(orderSize);
     msg1.purpose = htonl(REQUEST_MSG);
+    msg1.orderID = htonl(orderID);
 
-    if (sendto(sd, (void *) &msg1, sizeof(msg1), 0, (SA *) &srvrSkt, sizeof(srvrSkt)) < 0) {
+    if (sendto(sd, (void *) &msg1, sizeof(msg1), 0, (SA *) &ep->addr, sizeof(ep->addr)) < 0) {
         err_sys("Error sending request message");
     }
 
-    printf("Attempting factory server at %s : %hu\n", serverIP, port);
-    printf("\nPROCUREMENT Sent this message to the FACTORY server: "  );
+    printf("\nPROCUREMENT Sent this message to the FACTORY server %s: ", ep->name );
     printMsg( & msg1 );  puts("");
+}
+
+/*--------------------------------------------------------------------
+   Ask every server for its capacity, all at once, re-sending with
+   backoff. Servers that never answer take no part in the order.
+----------------------------------------------------------------------*/
+void probeEndpoints( void )
+{
+    struct pollfd      *pfd     = calloc( numEps , sizeof(struct pollfd) ) ;
+    int                *tries   = calloc( numEps , sizeof(int) ) ;
+    unsigned long long *sentUs  = calloc( numEps , sizeof(unsigned long long) ) ;
+    unsigned long long *retryAt = calloc( numEps , sizeof(unsigned long long) ) ;
+    int                 waiting = numEps ;
+
+    if ( pfd == NULL || tries == NULL || sentUs == NULL || retryAt == NULL )
+        err_sys("Error allocating the capacity query table");
+
+    for (int i = 0; i < numEps; i++) {
+        pfd[i].fd     = newSocket() ;
+        pfd[i].events = POLLIN ;
+        sendRequest( pfd[i].fd , &eps[i] , 0 , 0 ) ;
+        sentUs[i]  = nowUs() ;
+        retryAt[i] = sentUs[i] + backoffMS( 0 ) * 1000 ;
+    }
+
+    while ( waiting > 0 )
+    {
+        // Re-send or give up where the answer is overdue
+        unsigned long long now = nowUs() ;
+        long               wait = RETRY_MAX_MS ;
+        for (int i = 0; i < numEps; i++) {
+            if ( pfd[i].fd < 0 )
+                continue ;
+            if ( now >= retryAt[i] ) {
+                if ( tries[i] >= MAX_RETRIES ) {
+                    printf("PROCUREMENT ( by %s ): FACTORY server %s is not responding\n"
+                           , myName , eps[i].name );
+                    close( pfd[i].fd ) ;
+                    pfd[i].fd = -1 ;
+                    waiting-- ;
+                    continue ;
+                }
+                tries[i]++ ;
+                retries++ ;
+                sendRequest( pfd[i].fd , &eps[i] , 0 , 0 ) ;
+                retryAt[i] = now + backoffMS( tries[i] ) * 1000 ;
+            }
+            if ( (long) ( ( retryAt[i] - now ) / 1000 ) + 1 < wait )
+                wait = (long) ( ( retryAt[i] - now ) / 1000 ) + 1 ;
+        }
+        if ( waiting == 0 )
+            break ;
+
+        if ( poll( pfd , numEps , (int) wait ) < 0 ) {
+            if ( errno == EINTR )  continue ;
+            err_sys("Error waiting for capacity answers");
+        }
+
+        for (int i = 0; i < numEps; i++) {
+            if ( pfd[i].fd < 0 || !( pfd[i].revents & (POLLIN | POLLERR) ) )
+                continue ;
+
+            msgBuf cnf ;
+            ssize_t n = recv( pfd[i].fd , (void *) &cnf , sizeof(cnf) , 0 ) ;
+            if ( n == sizeof(cnf) && ntohl(cnf.purpose) == ORDR_CONFIRM ) {
+                eps[i].numFac   = ntohl(cnf.numFac) ;
+                eps[i].capacity = ntohl(cnf.capacity) ;
+                eps[i].alive    = 1 ;
+                statsInit( &eps[i].stats , eps[i].numFac ) ;
+                if ( tries[i] == 0 )     // a retried answer has no clear start time
+                    histAdd( &handshake , nowUs() - sentUs[i] ) ;
+                printf("PROCUREMENT ( by %s ) received this from the FACTORY server %s: "
+                       , myName , eps[i].name );
+                printMsg( & cnf );  puts("");
+            }
+            else
+                printf("PROCUREMENT ( by %s ): FACTORY server %s did not answer the capacity query\n"
+                       , myName , eps[i].name );
+
+            close( pfd[i].fd ) ;
+            pfd[i].fd = -1 ;
+            waiting-- ;
+        }
+    }
+
+    free( pfd ) ;
+    free( tries ) ;
+    free( sentUs ) ;
+    free( retryAt ) ;
+}
+
+/*-------------------------------------------------------*/
+void startLeg( endpoint_t *ep , unsigned share )
+{
+    if ( numLegs == maxLegs ) {
+        maxLegs = maxLegs ? 2 * maxLegs : 8 ;
+        legs    = realloc( legs , maxLegs * sizeof(leg_t) ) ;
+        if ( legs == NULL )
+            err_sys("Error allocating the order legs table");
+    }
+
+    leg_t *leg = &legs[ numLegs++ ] ;
+    memset( leg , 0 , sizeof(*leg) ) ;
+    leg->sd    = newSocket() ;
+    leg->ep    = ep ;
+    leg->state = LEG_WAIT_CONFIRM ;
+    leg->share = share ;
+    leg->twin  = -1 ;
+    if ( ++lastOrderID == 0 )       // 0 means "no order ID"
+        lastOrderID++ ;
+    leg->orderID = lastOrderID ;
+    gettimeofday( &leg->sentTime , NULL ) ;
+    leg->lastHeard = leg->sentTime ;
+    ep->busyLegs++ ;
+
+    sendRequest( leg->sd , ep , share , leg->orderID ) ;
+    leg->firstSentUs = nowUs() ;
+    leg->retryAtUs   = leg->firstSentUs + backoffMS( 0 ) * 1000 ;
+}
+
+/*--------------------------------------------------------------------
+   Hedging: leg 'i' has waited longer for its ORDR_CONFIRM than 95% of
+   the handshakes seen so far, so place the same order with the least
+   busy other server as well. Whichever confirms first keeps it; the
+   other is cancelled.
+----------------------------------------------------------------------*/
+void startHedge( int i )
+{
+    endpoint_t *target = NULL ;
+
+    legs[i].hedgeTried = 1 ;
+    for (int k = 0; k < numEps; k++) {
+        endpoint_t *ep = &eps[k] ;
+        if ( !ep->alive || ep == legs[i].ep )
+            continue ;
+        if ( target == NULL || ep->busyLegs < target->busyLegs
+             || ( ep->busyLegs == target->busyLegs && ep->capacity > target->capacity ) )
+            target = ep ;
+    }
+    if ( target == NULL )
+        return ;
+
+    printf("PROCUREMENT ( by %s ): No confirmation from %s after %.1f ms, hedging with %s\n"
+           , myName , legs[i].ep->name , ( nowUs() - legs[i].firstSentUs ) / 1000.0 , target->name );
+
+    startLeg( target , legs[i].share ) ;     // may move 'legs'
+    int h = numLegs - 1 ;
+    legs[h].isHedge = 1 ;
+    legs[h].twin    = i ;
+    legs[i].twin    = h ;
+    hedges++ ;
+}
+
+//------------------
+
+void sendControl( leg_t *leg , msgPurpose_t purpose )
+{
+    msgBuf  msg;
+    memset( &msg , 0 , sizeof(msg) ) ;
+    msg.purpose = htonl(purpose);
+
+    if (sendto(leg->sd, (void *) &msg, sizeof(msg), 0, (SA *) &leg->ep->addr, sizeof(leg->ep->addr)) < 0) {
+        perror("Error sending control message");
+    }
+}
+
+//------------------
+
+void sendCancel( leg_t *leg )
+{
+    sendControl( leg , CANCEL_MSG ) ;
+    leg->lastCancelUs = nowUs() ;
+}
+
+/*--------------------------------------------------------------------
+   The other leg of a hedged pair won: cancel this one. Its socket stays
+   open for a while so that a confirmation or report arriving late can
+   be answered with another CANCEL_MSG.
+----------------------------------------------------------------------*/
+void cancelLeg( leg_t *leg )
+{
+    printf("PROCUREMENT ( by %s ): Cancelling the duplicate order on %s\n", myName , leg->ep->name );
+
+    sendCancel( leg ) ;
+    leg->state         = LEG_CANCELLED ;
+    leg->twin          = -1 ;
+    leg->lingerUntilUs = nowUs() + CANCEL_LINGER_MS * 1000ull ;
+    leg->ep->busyLegs-- ;
+}
+
+/*--------------------------------------------------------------------
+   Split 'parts' over the live servers in proportion to their capacity.
+   If 'idleOnly' is set, only servers with no leg in progress are used.
+   Returns the number of parts actually placed.
+----------------------------------------------------------------------*/
+unsigned placeOrder( unsigned parts , int idleOnly )
+{
+    unsigned long long sumCap = 0 ;
+    unsigned           placed = 0 ;
+    endpoint_t        *biggest = NULL ;
+
+    for (int i = 0; i < numEps; i++) {
+        endpoint_t *ep = &eps[i] ;
+        if ( !ep->alive || ( idleOnly && ep->busyLegs > 0 ) )
+            continue ;
+        sumCap += ep->capacity ? ep->capacity : 1 ;
+        if ( biggest == NULL || ep->capacity > biggest->capacity )
+            biggest = ep ;
+    }
+    if ( biggest == NULL || parts == 0 )
+        return 0 ;
+
+    // Rounding leftovers go to the biggest server
+    unsigned long long bigShare = parts ;
+    for (int i = 0; i < numEps; i++) {
+        endpoint_t *ep = &eps[i] ;
+        if ( ep == biggest || !ep->alive || ( idleOnly && ep->busyLegs > 0 ) )
+            continue ;
+        unsigned share = (unsigned) ( (unsigned long long) parts
+                                      * ( ep->capacity ? ep->capacity : 1 ) / sumCap ) ;
+        if ( share > 0 ) {
+            startLeg( ep , share ) ;
+            placed   += share ;
+            bigShare -= share ;
+        }
+    }
+    startLeg( biggest , (unsigned) bigShare ) ;
+    placed += (unsigned) bigShare ;
+
+    return placed ;
+}
+
+/*--------------------------------------------------------------------
+   The server's SUMMARY_MSG of a leg: its count of the parts made is the
+   final one, reports lost on the way or not
+----------------------------------------------------------------------*/
+void takeSummary( leg_t *leg , unsigned partsMade )
+{
+    if ( partsMade != leg->made ) {
+        statsUnreported( &leg->ep->stats , (long long) partsMade - leg->made ) ;
+        leg->made = partsMade ;
+    }
+}
+
+/*--------------------------------------------------------------------
+   The leg's final count is in (see takeSummary). Parts the server did
+   not make, because the order was stopped early, are ordered again.
+----------------------------------------------------------------------*/
+void finishLeg( leg_t *leg )
+{
+    close( leg->sd ) ;
+    leg->sd    = -1 ;
+    if ( leg->state != LEG_COMPLETING )
+        leg->ep->busyLegs-- ;
+    leg->state = LEG_DONE ;
+
+    if ( leg->made < leg->share ) {
+        printf("PROCUREMENT ( by %s ): FACTORY server %s made only %u of %u parts\n"
+               , myName , leg->ep->name , leg->made , leg->share );
+        unassigned += leg->share - leg->made ;
+    }
+}
+
+/*--------------------------------------------------------------------
+   Stop waiting on a leg. The server is told to cancel the order, its
+   unfinished parts go back to the pool, and it gets no further work.
+----------------------------------------------------------------------*/
+void abandonLeg( leg_t *leg , const char *why )
+{
+    // Every sub-factory of it has completed: it is finished, not given up
+    if ( leg->state == LEG_COMPLETING ) {
+        printf("PROCUREMENT ( by %s ): FACTORY server %s failed (%s) after completing, "
+               "taking its completions as all %u parts made\n", myName , leg->ep->name , why , leg->share );
+        takeSummary( leg , leg->share ) ;
+        finishLeg( leg ) ;
+        return ;
+    }
+
+    // A cancelled duplicate still lingering: only stop listening to it
+    if ( leg->state != LEG_WAIT_CONFIRM && leg->state != LEG_RUNNING ) {
+        if ( leg->sd >= 0 )
+            close( leg->sd ) ;
+        leg->sd = -1 ;
+        return ;
+    }
+
+    unsigned unfinished = leg->share > leg->made ? leg->share - leg->made : 0 ;
+
+    // A hedged order still in the race on another server covers it
+    if ( leg->twin >= 0 ) {
+        legs[ leg->twin ].twin = -1 ;
+        leg->twin  = -1 ;
+        unfinished = 0 ;
+    }
+
+    printf("PROCUREMENT ( by %s ): Giving up on FACTORY server %s (%s), "
+           "re-ordering %u unfinished parts\n", myName , leg->ep->name , why , unfinished );
+
+    // In case it is only slow: stop it making parts that are ordered elsewhere
+    sendCancel( leg ) ;
+    close( leg->sd ) ;
+    leg->sd    = -1 ;
+    leg->state = LEG_ABANDONED ;
+    leg->ep->busyLegs-- ;
+    leg->ep->alive = 0 ;
+    unassigned += unfinished ;
+}
+
+/*--------------------------------------------------------------------
+   Every sub-factory of the leg has COMPLETED. Reports still on their
+   way keep counting until the SUMMARY_MSG arrives; if it does not, the
+   request is re-sent with the same order ID, which the server answers
+   with the summary. Missing reports are not missing parts.
+----------------------------------------------------------------------*/
+void completeLeg( leg_t *leg )
+{
+    leg->state     = LEG_COMPLETING ;
+    leg->ep->busyLegs-- ;       // the server may take more work meanwhile
+    leg->attempts  = 0 ;
+    leg->retryAtUs = nowUs() + backoffMS( 0 ) * 1000 ;
+}
+
+/*--------------------------------------------------------------------
+   The order of a leg waiting for confirmation is running: an
+   ORDR_CONFIRM, or a report that overtook or outlived a lost one.
+   A hedged twin loses the race.
+----------------------------------------------------------------------*/
+void confirmLeg( leg_t *leg , msgBuf *m , unsigned numFac , unsigned long long arrUs )
+{
+    endpoint_t *ep = leg->ep ;
+
+    if ( leg->twin >= 0 ) {
+        leg_t *other = &legs[ leg->twin ] ;
+        hedgesWon += leg->isHedge ;
+        leg->twin  = -1 ;
+        cancelLeg( other ) ;
+    }
+    leg->state = LEG_RUNNING ;
+    leg->activeLines = numFac ;
+    leg->confirmTime = leg->lastHeard ;
+    leg->confirmSentUs = (unsigned long long) ntohl(m->sentSec) * 1000000 + ntohl(m->sentUsec) ;
+    leg->lastSentUs = leg->confirmSentUs ;
+    leg->lastArrUs  = arrUs ;
+    leg->expectSeq  = 1 ;
+    leg->lastKeepaliveUs = arrUs ;
+    if ( numFac != ep->numFac ) {
+        // The server changed since the capacity query (a hot upgrade):
+        // widen its table, keeping what earlier legs counted
+        statsResize( &ep->stats , numFac ) ;
+        ep->numFac = numFac ;
+    }
+}
+
+/*-------------------------------------------------------*/
+void handleMessage( leg_t *leg , msgBuf *updtMsg )
+{
+    int facID = ntohl(updtMsg->facID);
+    int msgPartsMade = ntohl(updtMsg->partsMade);
+    unsigned duration = ntohl(updtMsg->duration);
+    msgPurpose_t purpose = ntohl(updtMsg->purpose);
+    endpoint_t *ep = leg->ep ;
+
+    unsigned long long arrUs = nowUs() ;
+    gettimeofday( &leg->lastHeard , NULL ) ;
+
+    // A cancelled duplicate: keep telling the server until it is quiet
+    if ( leg->state == LEG_CANCELLED ) {
+        leg->lingerUntilUs = arrUs + CANCEL_LINGER_MS * 1000ull ;
+        if ( purpose == PRODUCTION_MSG )
+            hedgeWaste += msgPartsMade ;
+        if ( ( purpose == ORDR_CONFIRM || purpose == PRODUCTION_MSG )
+             && arrUs - leg->lastCancelUs > TICK_MS * 1000ull )
+            sendCancel( leg ) ;
+        return ;
+    }
+
+    // Its reports show the order is running even if the ORDR_CONFIRM
+    // was lost or is still on the way
+    if ( leg->state == LEG_WAIT_CONFIRM
+         && ( purpose == PRODUCTION_MSG || purpose == COMPLETION_MSG ) ) {
+        printf("PROCUREMENT ( by %s ): Reports from %s before its confirmation, taking the order as confirmed\n"
+               , myName , ep->name );
+        confirmLeg( leg , updtMsg , ep->numFac , arrUs ) ;
+    }
+
+    // Inspect the incoming message
+    if (purpose == ORDR_CONFIRM && leg->state == LEG_WAIT_CONFIRM) {
+        if ( leg->attempts == 0 )    // a retried request has no clear start time
+            histAdd( &handshake , arrUs - leg->firstSentUs ) ;
+        confirmLeg( leg , updtMsg , ntohl(updtMsg->numFac) , arrUs ) ;
+        printf("PROCUREMENT ( by %s ) received this from the FACTORY server %s: "
+               , myName , ep->name );
+        printMsg( updtMsg );  puts("\n");
+    }
+    else if (purpose == PRODUCTION_MSG
+             && ( leg->state == LEG_RUNNING || leg->state == LEG_COMPLETING )) {
+        if ( !noteSeq( leg , ntohl(updtMsg->seqNum) ) )
+            return;     // a duplicated datagram
+        if (statsRecord(&ep->stats, facID, msgPartsMade, duration) < 0) {
+            printf("PROCUREMENT ( by %s ): Ignoring report from unknown Factory %s #%d\n"
+                   , myName, ep->name, facID);
+            return;
+        }
+        leg->made += msgPartsMade ;
+        noteTiming( leg , updtMsg , arrUs ) ;
+        printf("PROCUREMENT ( by %s ): Factory %s #%-3d produced %-5d parts in %-5d milliSecs\n"
+               , myName, ep->name, facID, msgPartsMade, duration);
+    }
+    else if (purpose == COMPLETION_MSG && leg->state == LEG_RUNNING) {
+        if ( !noteSeq( leg , ntohl(updtMsg->seqNum) ) )
+            return;
+        printf("PROCUREMENT ( by %s ): Factory %s #%-3d         COMPLETED its task\n"
+               , myName, ep->name, facID);
+        noteTiming( leg , updtMsg , arrUs ) ;
+        if ( --leg->activeLines <= 0 )
+            completeLeg( leg ) ;
+    }
+    else if (purpose == SUMMARY_MSG && leg->state == LEG_WAIT_CONFIRM) {
+        // Our request was re-sent after the order was over and every
+        // reply got lost: the server answers for the order it already
+        // made, so take its count rather than order the parts again
+        if ( leg->twin >= 0 ) {
+            leg_t *other = &legs[ leg->twin ] ;
+            hedgesWon += leg->isHedge ;
+            leg->twin  = -1 ;
+            cancelLeg( other ) ;
+        }
+        printf("PROCUREMENT ( by %s ) received this from the FACTORY server %s: "
+               , myName , ep->name );
+        printMsg( updtMsg );  puts("");
+        takeSummary( leg , msgPartsMade ) ;
+        finishLeg( leg ) ;
+    }
+    else if (purpose == SUMMARY_MSG
+             && ( leg->state == LEG_RUNNING || leg->state == LEG_COMPLETING )) {
+        // The server's final count. It can overtake completions that
+        // are on the way, or the server stopped the order: only what
+        // it did not make is ordered again.
+        printf("PROCUREMENT ( by %s ) received this from the FACTORY server %s: "
+               , myName , ep->name );
+        printMsg( updtMsg );  puts("");
+        takeSummary( leg , msgPartsMade ) ;
+        finishLeg( leg ) ;
+    }
+    else if (purpose == PROTOCOL_ERR){
+        printf("PROCUREMENT ( by %s ): Received invalid msg from %s ", myName, ep->name);
+        printMsg(updtMsg); puts("");
+        abandonLeg( leg , "protocol error" ) ;
+    }
+    else if (purpose == ORDR_CONFIRM || purpose == PRODUCTION_MSG || purpose == COMPLETION_MSG
+             || purpose == SUMMARY_MSG) {
+        // A duplicate or out-of-order datagram: nothing to account for
+    } else {
+        printf("PROCUREMENT ( by %s ): Received an invalid message from %s\n", myName, ep->name);
+        abandonLeg( leg , "invalid message" ) ;
+    }
+}
+
+/*--------------------------------------------------------------------
+   Re-send overdue requests and hedge slow ones; give up on legs that
+   never got confirmed, went silent, or produce far below the capacity
+   their server advertised. Returns how many ms until the next retry or
+   hedge is due, at most TICK_MS.
+----------------------------------------------------------------------*/
+long checkLegs( void )
+{
+    unsigned long long now  = nowUs() ;
+    long               wait = TICK_MS ;
 
-    /* Now, wait for order confirmation from the Factory server */
-    msgBuf  msg2;
-    printf ("\nPROCUREMENT is now waiting for order confirmation ...\n" );
+    for (int i = 0; i < numLegs; i++) {
+        leg_t *leg = &legs[i] ;
 
-    addrLen = sizeof(srvrSkt);
-    if (recvfrom(sd, (void *) &msg2, sizeof(msg2), 0, (SA *) &srvrSkt, &addrLen) < 0) {
-        err_sys("Error receiving order confirmation message");
+        if ( leg->state == LEG_WAIT_CONFIRM ) {
+            if ( now >= leg->retryAtUs ) {
+                if ( leg->attempts >= MAX_RETRIES ) {
+                    abandonLeg( leg , "no order confirmation" ) ;
+                    continue ;
+                }
+                leg->attempts++ ;
+                retries++ ;
+                printf("PROCUREMENT ( by %s ): No confirmation from %s, retry #%d\n"
+                       , myName , leg->ep->name , leg->attempts );
+                sendRequest( leg->sd , leg->ep , leg->share , leg->orderID ) ;
+                leg->retryAtUs = now + backoffMS( leg->attempts ) * 1000 ;
+            }
+            if ( (long) ( ( leg->retryAtUs - now ) / 1000 ) + 1 < wait )
+                wait = (long) ( ( leg->retryAtUs - now ) / 1000 ) + 1 ;
+
+            if ( hedged && !leg->hedgeTried && !leg->isHedge ) {
+                unsigned long long hedgeAt = leg->firstSentUs + hedgeDelayUs() ;
+                if ( now >= hedgeAt ) {
+                    startHedge( i ) ;
+                    leg = &legs[i] ;
+                }
+                else if ( (long) ( ( hedgeAt - now ) / 1000 ) + 1 < wait )
+                    wait = (long) ( ( hedgeAt - now ) / 1000 ) + 1 ;
+            }
+        }
+        else if ( leg->state == LEG_RUNNING ) {
+            long running = msSince( &leg->confirmTime ) ;
+            double expected = (double) leg->ep->capacity * running / 1000.0 ;
+            if ( expected > leg->share )
+                expected = leg->share ;
+
+            if ( msSince( &leg->lastHeard ) > STALL_MS )
+                abandonLeg( leg , "stopped responding" ) ;
+            else if ( running > SLOW_WARMUP_MS && leg->made < SLOW_FRACTION * expected )
+                abandonLeg( leg , "too slow" ) ;
+            else if ( now - leg->lastKeepaliveUs >= KEEPALIVE_MS * 1000ull ) {
+                sendControl( leg , KEEPALIVE_MSG ) ;
+                leg->lastKeepaliveUs = now ;
+            }
+        }
+        else if ( leg->state == LEG_COMPLETING ) {
+            if ( now >= leg->retryAtUs ) {
+                if ( leg->attempts >= MAX_RETRIES ) {
+                    // Every sub-factory said it completed its task
+                    printf("PROCUREMENT ( by %s ): No order summary from %s, taking its "
+                           "completions as all %u parts made\n", myName , leg->ep->name , leg->share );
+                    takeSummary( leg , leg->share ) ;
+                    finishLeg( leg ) ;
+                    continue ;
+                }
+                leg->attempts++ ;
+                printf("PROCUREMENT ( by %s ): No order summary from %s, asking again\n"
+                       , myName , leg->ep->name );
+                sendRequest( leg->sd , leg->ep , leg->share , leg->orderID ) ;
+                leg->retryAtUs = now + backoffMS( leg->attempts ) * 1000 ;
+            }
+            if ( (long) ( ( leg->retryAtUs - now ) / 1000 ) + 1 < wait )
+                wait = (long) ( ( leg->retryAtUs - now ) / 1000 ) + 1 ;
+        }
+        else if ( leg->state == LEG_CANCELLED && leg->sd >= 0 && now >= leg->lingerUntilUs ) {
+            close( leg->sd ) ;
+            leg->sd = -1 ;
+        }
+    }
+    return wait ;
+}
+
+/*--------------------------------------------------------------------
+   Ctrl-C: the main loop cancels whatever is still being made
+----------------------------------------------------------------------*/
+void interrupt( int sig )
+{
+    interrupted = sig ;
+}
+
+//------------------
+
+void cancelAll( void )
+{
+    printf("\nPROCUREMENT ( by %s ): Interrupted, cancelling the rest of the order\n", myName );
+    for (int i = 0; i < numLegs; i++) {
+        leg_t *leg = &legs[i] ;
+        if ( leg->state == LEG_COMPLETING ) {
+            close( leg->sd ) ;      // done; keep what was reported so far
+            leg->sd    = -1 ;
+            leg->state = LEG_DONE ;
+            continue ;
+        }
+        if ( leg->state != LEG_WAIT_CONFIRM && leg->state != LEG_RUNNING )
+            continue ;
+        sendCancel( leg ) ;
+        close( leg->sd ) ;
+        leg->sd    = -1 ;
+        leg->state = LEG_CANCELLED ;
+        leg->ep->busyLegs-- ;
     }
+}
 
-    printf("PROCUREMENT ( by %s ) received this from the FACTORY server: ", myName);
-    printMsg( & msg2 );  puts("\n");
+/*-------------------------------------------------------*/
+int main( int argc , char *argv[] )
+{
+    struct timeval startTime; // starting time
+    double elapsedMS; // total time taken
 
-    gettimeofday(&startTime, NULL); 
-    numFactories = ntohl(msg2.numFac);
-    activeFactories = numFactories;
+    printf("\nThis is procurement. ( by %s )\n\n", myName);
+    fflush( stdout ) ;
+
+    int opt ;
+    while ( ( opt = getopt( argc , argv , "h" ) ) != -1 )
+    {
+        switch ( opt ) {
+          case 'h':
+            hedged = 1 ;
+            break ;
+          default:
+            argc = 0 ;      // print the usage below
+            break ;
+        }
+    }
+    argc -= optind - 1 ;
+    argv += optind - 1 ;
 
-    // Monitor all Active Factory Lines & Collect Production Reports
-    while ( activeFactories > 0 ) // wait for messages from sub-factories
+    if ( argc < 4 || argc % 2 != 0 )
     {
-        // Receive the update message
-        msgBuf updtMsg;
-        if (recvfrom(sd, (void *) &updtMsg, sizeof(updtMsg), 0, (SA *) &srvrSkt, &addrLen) < 0) {
-            err_sys("Error receiving update message");
-        }
-
-        int facID = ntohl(updtMsg.facID);
-        int msgPartsMade = ntohl(updtMsg.partsMade);
-        unsigned duration = ntohl(updtMsg.duration);
-        msgPurpose_t purpose = ntohl(updtMsg.purpose);
-
-       // Inspect the incoming message
-        if (purpose == PRODUCTION_MSG) {
-        iters[facID]++;
-        partsMade[facID] += msgPartsMade;
-        printf("PROCUREMENT ( by %s ): Factory #%-3d produced %-5d parts in %-5d milliSecs\n", myName, facID, msgPartsMade, duration);
-        } 
-        else if (purpose == COMPLETION_MSG) {
-            activeFactories--;
-            printf("PROCUREMENT ( by %s ): Factory #%-3d         COMPLETED its task\n", myName, facID);
-        }
-        else if (purpose == PROTOCOL_ERR){
-            printf("PROCUREMENT ( by %s ): Received invalid msg ", myName);
-            printMsg(&updtMsg); puts("");
-            close(sd);
-            exit(1);
-        } else {
-            printf("PROCUREMENT ( by %s ): Received an invalid message\n", myName);
-            close(sd);
-            exit(1);
-        }
-    } 
+        printf("PROCUREMENT Usage: %s  [-h]  <order_size> <FactoryServerIP>  <port>  [<FactoryServerIP>  <port> ...]\n" , argv[0] );
+        exit( -1 ) ;
+    }
+
+    unsigned        orderSize  = atoi( argv[1] ) ;
+    srandom( (unsigned) time(NULL) ^ getpid() ) ;
+    lastOrderID = (unsigned) random() ;
+    histInit( &handshake ) ;
+    sigactionWrapper( SIGINT , interrupt ) ;
+    sigactionWrapper( SIGTERM , interrupt ) ;
+
+    // Prepare the socket address of every Factory server
+    numEps = (argc - 2) / 2 ;
+    eps    = calloc( numEps , sizeof(endpoint_t) ) ;
+    if ( eps == NULL )
+        err_sys("Error allocating the server table");
+
+    for (int i = 0; i < numEps; i++) {
+        char	       *serverIP   = argv[ 2 + 2*i ] ;
+        unsigned short  port       = (unsigned short) atoi( argv[ 3 + 2*i ] ) ;
+        endpoint_t     *ep         = &eps[i] ;
+
+        ep->addr.sin_family = AF_INET;
+        ep->addr.sin_port = htons(port);
+        if (inet_pton(AF_INET, serverIP, (void *) &ep->addr.sin_addr.s_addr) != 1) {
+            err_quit("Invalid IP Address\n");
+        }
+        snprintf( ep->name , sizeof(ep->name) , "%s:%hu" , serverIP , port ) ;
+        printf("Attempting factory server at %s : %hu\n", serverIP, port);
+    }
+
+    /* Find out what each server can do, then split the order accordingly */
+    probeEndpoints() ;
+
+    printf ("\nPROCUREMENT is now placing the order and waiting for order confirmation ...\n" );
+    gettimeofday(&startTime, NULL);
+    if ( placeOrder( orderSize , 0 ) == 0 && orderSize > 0 )
+        err_quit("No FACTORY server is available\n");
+
+    // Monitor all order legs & Collect Production Reports
+    struct pollfd *pfd = NULL ;
+    int           *pfdLeg = NULL ;
+    int            pfdCap = 0 ;
+    long           wait = 0 ;
+    while ( 1 )
+    {
+        // Re-order what was taken back from failed legs on idle servers
+        if ( interrupted ) {
+            cancelAll() ;
+            break ;
+        }
+        if ( unassigned > 0 )
+            unassigned -= placeOrder( unassigned , 1 ) ;
+
+        int nfds = 0 , busy = 0 ;
+        for (int i = 0; i < numEps; i++)
+            busy += eps[i].busyLegs ;
+        for (int i = 0; i < numLegs; i++)
+            busy += legs[i].state == LEG_COMPLETING ;
+        if ( busy == 0 )
+            break ;     // nothing in progress and nobody left to take the rest
+
+        if ( pfdCap < numLegs ) {
+            pfdCap = maxLegs ;
+            pfd    = realloc( pfd    , pfdCap * sizeof(struct pollfd) ) ;
+            pfdLeg = realloc( pfdLeg , pfdCap * sizeof(int) ) ;
+            if ( pfd == NULL || pfdLeg == NULL )
+                err_sys("Error allocating the poll table");
+        }
+        for (int i = 0; i < numLegs; i++) {
+            if ( legs[i].sd < 0 )
+                continue ;
+            pfd[nfds].fd     = legs[i].sd ;
+            pfd[nfds].events = POLLIN ;
+            pfdLeg[nfds++]   = i ;
+        }
+
+        if ( poll( pfd , nfds , wait ) < 0 && errno != EINTR )
+            err_sys("Error waiting for update messages");
+
+        for (int k = 0; k < nfds; k++) {
+            if ( !( pfd[k].revents & (POLLIN | POLLERR) ) )
+                continue ;
+
+            leg_t *leg = &legs[ pfdLeg[k] ] ;
+            msgBuf updtMsg;
+            ssize_t n = recv(leg->sd, (void *) &updtMsg, sizeof(updtMsg), 0) ;
+            if ( n < 0 ) {
+                abandonLeg( leg , strerror(errno) ) ;
+                continue ;
+            }
+            if ( n == sizeof(updtMsg) )
+                handleMessage( leg , &updtMsg ) ;
+        }
+
+        wait = checkLegs() ;
+    }
+    free( pfd ) ;
+    free( pfdLeg ) ;
+
     // Get ending time and calculate total time
-    gettimeofday(&endTime, NULL);
-    elapsedMS = (endTime.tv_sec - startTime.tv_sec) * 1000L +
-            (endTime.tv_usec - startTime.tv_usec) / 1000L;
+    elapsedMS = ( nowUs() - ( (unsigned long long) startTime.tv_sec * 1000000 + startTime.tv_usec ) ) / 1000.0 ;
 
     // Print the summary report
-    totalItems  = 0 ;
+    unsigned long long totalItems = 0 ;
+    latHist transit , jitter , iteration ;
+    histInit( &transit ) ;
+    histInit( &jitter ) ;
+    histInit( &iteration ) ;
     printf("\n\n****** PROCUREMENT ( by %s ) Summary Report ******\n", myName);
-    printf("\tSub-Factory\tParts Made\tIterations\n");
 
-    for (int i = 1; i <= numFactories; i++) {
-        printf("\t\t%-3d\t\t%-5d\t\t%-3d\n", i, partsMade[i], iters[i]);
-        totalItems += partsMade[i];
+    for (int i = 0; i < numEps; i++) {
+        endpoint_t *ep = &eps[i] ;
+        int         nLegs = 0 ;
+        for (int j = 0; j < numLegs; j++)
+            nLegs += legs[j].ep == ep ;
+
+        printf("\nFACTORY server %s : %u sub-factories , %u parts/sec , %d order leg(s)%s\n"
+               , ep->name , ep->numFac , ep->capacity , nLegs , ep->alive ? "" : " , GIVEN UP" );
+        statsPrint( &ep->stats );
+        printf("Parts made by this server = %llu\n", ep->stats.totalParts);
+        totalItems += ep->stats.totalParts ;
+        histMerge( &transit , &ep->stats.transit ) ;
+        histMerge( &jitter , &ep->stats.jitter ) ;
+        histMerge( &iteration , &ep->stats.iteration ) ;
     }
 
     printf("=========================================================\n") ;
 
-    printf("Grand total parts made = %5d vs order size of %5d\n", totalItems, orderSize);
+    printf("Grand total parts made = %5llu vs order size of %5d\n", totalItems, orderSize);
     printf("Order-to-Completion time = %.1f milliSeconds\n", elapsedMS);
+    histPrint( &iteration , "All iterations (ms)" , 1000.0 ) ;
+    histPrint( &transit   , "All transits (ms)" , 1000.0 ) ;
+    histPrint( &jitter    , "All jitter (ms)" , 1000.0 ) ;
+    histPrint( &handshake , "Order placement (ms)" , 1000.0 ) ;
+    if ( retries > 0 || hedges > 0 )
+        printf("Order placement        : %u retries , %u hedged (%u won by the hedge) , "
+               "%u parts made on cancelled duplicates\n", retries , hedges , hedgesWon , hedgeWaste );
+    if ( unassigned > 0 )
+        printf("%u parts could not be placed: no FACTORY server left\n", unassigned);
 
     printf( "\n>>> PROCUREMENT (by %s ) Terminated\n", myName ) ;
 
-    return 0 ;
+    for (int i = 0; i < numEps; i++)
+        statsFree( &eps[i].stats );
+    free( legs );
+    free( eps );
+
+    return unassigned > 0 ? 1 : 0 ;
 }
@@ -0,0 +1,98 @@
+#!/bin/bash
+#---------------------------------------------------------------------
+# Assignment : PA-04 Threads - UDP
+# Date       : 12/1/2025
+# Author     : Kyle Mirra      Akwasi Okyere
+# File Name  : impair-matrix.sh
+#
+# Run one order through the impairment proxy for every profile below
+# and record goodput, completion time and whether the grand total was
+# right: by procurement's count, and by the factory's count of what it
+# really made. One FACTORY server serves the whole matrix, so every
+# profile sees the same sub-factories.
+#
+#       scripts/impair-matrix.sh  [orderSize]  [numThreads]
+#
+# The table goes to stdout and to impair-matrix.log; each run's full
+# output is kept under impair-runs/.
+#---------------------------------------------------------------------
+
+ORDER=${1:-1000}
+THREADS=${2:-5}
+FPORT=${FPORT:-52500}          # factory
+PPORT=${PPORT:-52501}          # proxy
+TIMEOUT=${TIMEOUT:-120}        # seconds per run
+SEED=${SEED:-1}
+
+PROFILES=(
+    "clean|"
+    "loss-1%|-l 1"
+    "loss-5%|-l 5"
+    "loss-20%|-l 20"
+    "reorder-10%|-r 10"
+    "dup-5%|-d 5"
+    "delay-50+25ms|-D 50 -j 25"
+    "bw-32kbps|-b 32"
+    "mixed|-l 2 -r 5 -d 1 -D 20 -j 10"
+)
+
+cd "$(dirname "$0")/.." || exit 1
+make -s procurement factory impair factory-top || exit 1
+mkdir -p impair-runs
+
+stdbuf -oL ./factory "$THREADS" "$FPORT" > impair-runs/factory.out 2>&1 &
+FPID=$!
+trap 'kill $FPID 2>/dev/null' EXIT
+sleep 0.5
+
+LOG=impair-matrix.log
+# Wait until the factory has no order left, at most 10 s
+factoryIdle() {
+    for i in $(seq 100); do
+        ./factory-top -n 1 "$FPORT" 2>/dev/null | grep -q "^Active orders 0 " && return 0
+        sleep 0.1
+    done
+    return 1
+}
+
+printf "%-15s %5s %13s %8s %8s %12s %12s %10s %s\n" \
+       "profile" "rc" "made/order" "factory" "correct" "time (ms)" "goodput/s" "p99 (ms)" "proxy dropped/dup/reordered" | tee "$LOG"
+
+for entry in "${PROFILES[@]}"; do
+    name=${entry%%|*}
+    opts=${entry#*|}
+
+    ./impair -s "$SEED" $opts "$PPORT" 127.0.0.1 "$FPORT" > "impair-runs/$name.impair" 2>&1 &
+    IPID=$!
+    sleep 0.2
+
+    before=$(wc -l < impair-runs/factory.out)
+    timeout "$TIMEOUT" ./procurement "$ORDER" 127.0.0.1 "$PPORT" > "impair-runs/$name.out" 2>&1
+    rc=$?
+    factoryIdle
+
+    kill -INT $IPID
+    wait $IPID 2>/dev/null
+
+    out="impair-runs/$name.out"
+    made=$(sed -n 's/^Grand total parts made = *\([0-9]*\).*/\1/p' "$out")
+    ms=$(sed -n 's/^Order-to-Completion time = *\([0-9.]*\).*/\1/p' "$out")
+    p99=$(sed -n 's/^All transits (ms) *: .*p99 \([0-9.]*\).*/\1/p' "$out")
+    made=${made:-0} ; ms=${ms:-0} ; p99=${p99:--}
+
+    # What the factory made for this run's orders, cancelled duplicates included
+    fmade=$(tail -n +$((before + 1)) impair-runs/factory.out |
+            awk '/^Grand total parts made/ { sum += $6 } END { print sum + 0 }')
+
+    correct=no
+    [ "$rc" -eq 0 ] && [ "$made" -eq "$ORDER" ] && [ "$fmade" -eq "$ORDER" ] && correct=yes
+    goodput=$(awk -v m="$made" -v t="$ms" 'BEGIN { printf "%.1f", (t > 0 ? m * 1000 / t : 0) }')
+    proxy=$(awk -F'[:,]' '/->/ && /received/ { for (i = 1; i <= NF; i++) {
+                                if ($i ~ /dropped/)    d += $i + 0
+                                if ($i ~ /duplicated/) u += $i + 0
+                                if ($i ~ /reordered/)  r += $i + 0 } }
+                          END { printf "%d/%d/%d", d, u, r }' "impair-runs/$name.impair")
+
+    printf "%-15s %5s %13s %8s %8s %12s %12s %10s %s\n" \
+           "$name" "$rc" "$made/$ORDER" "$fmade" "$correct" "$ms" "$goodput" "$p99" "$proxy" | tee -a "$LOG"
+done
@@ -0,0 +1,76 @@
+//---------------------------------------------------------------------
+// Assignment : PA-04 Threads - UDP
+// Date       : 12/1/2025
+// Author     : Kyle Mirra      Akwasi Okyere
+// File Name  : slab.c
+//---------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "wrappers.h"
+#include "slab.h"
+
+//------------------
+
+static void *newBlock( slabPool *p )
+{
+    void *block = aligned_alloc( CACHE_LINE , p->blockSize ) ;
+    if ( block == NULL )
+        err_sys( "Failed to allocate a slab block" ) ;
+    p->blocks++ ;
+    return block ;
+}
+
+/*--------------------------------------------------------------------
+   Blocks hold at least 'blockSize' bytes; 'prealloc' of them are
+   allocated right away
+----------------------------------------------------------------------*/
+void slabInit( slabPool *p , size_t blockSize , unsigned prealloc )
+{
+    memset( (void *) p , 0 , sizeof( *p ) ) ;
+    p->blockSize = CACHE_ALIGN( blockSize < sizeof( void * ) ? sizeof( void * ) : blockSize ) ;
+    pthread_mutex_init( &p->lock , NULL ) ;
+
+    while ( prealloc-- > 0 ) {
+        void *block = newBlock( p ) ;
+        *(void **) block = p->free ;
+        p->free = block ;
+    }
+}
+
+/*--------------------------------------------------------------------
+   A block from the free list, or a new one if it is empty. The
+   contents are whatever the previous user left.
+----------------------------------------------------------------------*/
+void *slabGet( slabPool *p )
+{
+    void *block ;
+
+    pthread_mutex_lock( &p->lock ) ;
+    p->gets++ ;
+    p->inUse++ ;
+    if ( p->free ) {
+        block   = p->free ;
+        p->free = *(void **) block ;
+    }
+    else {
+        p->heapAllocs++ ;
+        block = newBlock( p ) ;
+    }
+    pthread_mutex_unlock( &p->lock ) ;
+
+    return block ;
+}
+
+//------------------
+
+void slabPut( slabPool *p , void *block )
+{
+    pthread_mutex_lock( &p->lock ) ;
+    *(void **) block = p->free ;
+    p->free = block ;
+    p->inUse-- ;
+    pthread_mutex_unlock( &p->lock ) ;
+}
@@ -0,0 +1,42 @@
+//---------------------------------------------------------------------
+// Assignment : PA-04 Threads - UDP
+// Date       : 12/1/2025
+// Author     : Kyle Mirra      Akwasi Okyere
+// File Name  : slab.h
+//---------------------------------------------------------------------
+
+#ifndef  SLAB_H
+#define  SLAB_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+/*--------------------------------------------------------------------
+   Pool of equally sized, cache-line-aligned blocks that are recycled
+   instead of freed.
+
+   A block is taken from the free list if there is one; only when the
+   pool runs dry is a new block allocated from the heap, so once the
+   pool has grown to the peak number of blocks in use, getting and
+   returning blocks does no heap allocation at all. The counters show
+   how often that still happens.
+----------------------------------------------------------------------*/
+#define CACHE_LINE      64
+
+#define CACHE_ALIGN( n )    ( ( (n) + CACHE_LINE - 1 ) & ~(size_t) ( CACHE_LINE - 1 ) )
+
+typedef struct {
+    size_t           blockSize ;         // multiple of CACHE_LINE
+    void            *free ;              // free blocks, linked through their first word
+    pthread_mutex_t  lock ;
+    unsigned long    inUse ,             // blocks handed out now
+                     blocks ,            // blocks owned by the pool
+                     gets ,              // slabGet() calls so far
+                     heapAllocs ;        // ... that had to allocate a block
+} slabPool ;
+
+void   slabInit( slabPool *p , size_t blockSize , unsigned prealloc ) ;
+void  *slabGet ( slabPool *p ) ;
+void   slabPut ( slabPool *p , void *block ) ;
+
+#endif
@@ -0,0 +1,256 @@
+//---------------------------------------------------------------------
+// Assignment : PA-04 Threads - UDP
+// Date       : 12/1/2025
+// Author     : Kyle Mirra      Akwasi Okyere
+// File Name  : stats.c
+//---------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "wrappers.h"
+#include "stats.h"
+
+/*--------------------------------------------------------------------
+   Latency histograms
+----------------------------------------------------------------------*/
+void histInit( latHist *h )
+{
+    memset( (void *) h , 0 , sizeof( *h ) ) ;
+    h->min = ~0ull ;
+}
+
+//------------------
+
+static int histBucket( unsigned long long v )
+{
+    if ( v < HIST_SUB )
+        return (int) v ;
+
+    int top = 63 - __builtin_clzll( v ) ;          // v >= 2^top
+    int sub = (int) ( v >> ( top - HIST_SUB_BITS ) ) & ( HIST_SUB - 1 ) ;
+    return ( top - HIST_SUB_BITS + 1 ) * HIST_SUB + sub ;
+}
+
+//------------------
+
+static unsigned long long histMid( int b )
+{
+    if ( b < HIST_SUB )
+        return b ;
+
+    int                shift = b / HIST_SUB - 1 ;
+    unsigned long long low   = (unsigned long long) ( HIST_SUB + b % HIST_SUB ) << shift ;
+    return low + ( ( 1ull << shift ) >> 1 ) ;
+}
+
+//------------------
+
+void histAdd( latHist *h , unsigned long long v )
+{
+    h->bucket[ histBucket( v ) ]++ ;
+    h->count++ ;
+    h->sum += v ;
+    if ( v < h->min )  h->min = v ;
+    if ( v > h->max )  h->max = v ;
+}
+
+//------------------
+
+void histMerge( latHist *into , const latHist *from )
+{
+    for ( int b = 0 ; b < HIST_BUCKETS ; b++ )
+        into->bucket[b] += from->bucket[b] ;
+    into->count += from->count ;
+    into->sum   += from->sum ;
+    if ( from->min < into->min )  into->min = from->min ;
+    if ( from->max > into->max )  into->max = from->max ;
+}
+
+/*--------------------------------------------------------------------
+   Smallest recorded value that 'pct' percent of the samples do not
+   exceed (to within the bucket width)
+----------------------------------------------------------------------*/
+unsigned long long histPercentile( const latHist *h , double pct )
+{
+    if ( h->count == 0 )
+        return 0 ;
+
+    unsigned long long rank = (unsigned long long) ( pct / 100.0 * h->count + 0.5 ) ;
+    unsigned long long seen = 0 ;
+    if ( rank < 1 )         rank = 1 ;
+    if ( rank > h->count )  rank = h->count ;
+
+    for ( int b = 0 ; b < HIST_BUCKETS ; b++ ) {
+        seen += h->bucket[b] ;
+        if ( seen >= rank ) {
+            unsigned long long v = histMid( b ) ;
+            if ( v < h->min )  v = h->min ;
+            if ( v > h->max )  v = h->max ;
+            return v ;
+        }
+    }
+    return h->max ;
+}
+
+//------------------
+
+void histPrint( const latHist *h , const char *label , double scale )
+{
+    if ( h->count == 0 )
+        return ;
+
+    printf("%-23s: p50 %.1f , p90 %.1f , p99 %.1f , max %.1f , mean %.1f over %llu samples\n"
+           , label
+           , histPercentile( h , 50 ) / scale , histPercentile( h , 90 ) / scale
+           , histPercentile( h , 99 ) / scale , h->max / scale
+           , (double) h->sum / h->count / scale , h->count ) ;
+}
+
+/*--------------------------------------------------------------------
+   Allocate zeroed counters for 'numFac' sub-factories
+----------------------------------------------------------------------*/
+void statsInit( facStats *s , unsigned numFac )
+{
+    memset( (void *) s , 0 , sizeof( *s ) ) ;
+    s->numFac      = numFac ;
+    s->minDuration = ~0u ;
+    histInit( &s->transit ) ;
+    histInit( &s->jitter ) ;
+    histInit( &s->iteration ) ;
+
+    if ( numFac == 0 )
+        return ;
+
+    s->lastSent = calloc( numFac , sizeof( unsigned long long ) + 2 * sizeof( unsigned ) ) ;
+    if ( s->lastSent == NULL )
+        err_sys( "Failed to allocate sub-factory statistics" ) ;
+    s->iters     = (unsigned *) ( s->lastSent + numFac ) ;
+    s->partsMade = s->iters + numFac ;
+}
+
+/*--------------------------------------------------------------------
+   Make room for sub-factories up to 'numFac' (a server restarted with
+   more of them). Counts so far, running totals included, are kept; the
+   table never shrinks, since its upper lines may hold earlier counts.
+----------------------------------------------------------------------*/
+void statsResize( facStats *s , unsigned numFac )
+{
+    if ( numFac <= s->numFac )
+        return ;
+
+    unsigned long long *lastSent = calloc( numFac , sizeof( unsigned long long ) + 2 * sizeof( unsigned ) ) ;
+    if ( lastSent == NULL )
+        err_sys( "Failed to allocate sub-factory statistics" ) ;
+    unsigned *iters     = (unsigned *) ( lastSent + numFac ) ;
+    unsigned *partsMade = iters + numFac ;
+
+    if ( s->numFac > 0 ) {
+        memcpy( lastSent  , s->lastSent  , s->numFac * sizeof( unsigned long long ) ) ;
+        memcpy( iters     , s->iters     , s->numFac * sizeof( unsigned ) ) ;
+        memcpy( partsMade , s->partsMade , s->numFac * sizeof( unsigned ) ) ;
+    }
+    free( s->lastSent ) ;
+    s->lastSent  = lastSent ;
+    s->iters     = iters ;
+    s->partsMade = partsMade ;
+    s->numFac    = numFac ;
+}
+
+/*--------------------------------------------------------------------
+   Account for one production report. Returns -1 (and counts it as a
+   bad report) if facID is outside 1..numFac, 0 otherwise.
+----------------------------------------------------------------------*/
+int statsRecord( facStats *s , unsigned facID , unsigned parts , unsigned duration )
+{
+    if ( facID < 1 || facID > s->numFac ) {
+        s->badReports++ ;
+        return -1 ;
+    }
+
+    s->iters[ facID-1 ]++ ;
+    s->partsMade[ facID-1 ] += parts ;
+
+    s->totalParts    += parts ;
+    s->totalIters    ++ ;
+    s->totalDuration += duration ;
+    if ( duration < s->minDuration )  s->minDuration = duration ;
+    if ( duration > s->maxDuration )  s->maxDuration = duration ;
+
+    return 0 ;
+}
+
+/*--------------------------------------------------------------------
+   Account for 'parts' that an order summary says were made but whose
+   reports never arrived (negative: reports that were counted twice).
+   They go into the totals only; which sub-factory made them is unknown.
+----------------------------------------------------------------------*/
+void statsUnreported( facStats *s , long long parts )
+{
+    s->unreported += parts ;
+    s->totalParts += parts ;
+}
+
+/*--------------------------------------------------------------------
+   Account for the send time of a report from 'facID'. The iteration
+   time is measured from its previous report, or from 'sinceUs' (when
+   the order was confirmed) if that is more recent. Times are the
+   factory's clock, so they are not affected by the network.
+----------------------------------------------------------------------*/
+int statsTiming( facStats *s , unsigned facID , unsigned long long sentUs ,
+                 unsigned long long sinceUs )
+{
+    if ( facID < 1 || facID > s->numFac )
+        return -1 ;
+
+    unsigned long long from = s->lastSent[ facID-1 ] ;
+    if ( from < sinceUs )
+        from = sinceUs ;
+    if ( from > 0 && sentUs >= from )
+        histAdd( &s->iteration , sentUs - from ) ;
+    s->lastSent[ facID-1 ] = sentUs ;
+
+    return 0 ;
+}
+
+/*--------------------------------------------------------------------
+   Print the per sub-factory table followed by the iteration-time
+   figures. Totals come from the running counters.
+----------------------------------------------------------------------*/
+void statsPrint( const facStats *s )
+{
+    printf("\tSub-Factory\tParts Made\tIterations\n");
+    for ( unsigned i = 0 ; i < s->numFac ; i++ )
+        printf("\t\t%-3u\t\t%-5u\t\t%-3u\n", i + 1, s->partsMade[i], s->iters[i]);
+
+    if ( s->totalIters > 0 )
+        printf("Reported duration (ms) : min %u , max %u , mean %.1f over %llu iterations\n"
+               , s->minDuration , s->maxDuration
+               , (double) s->totalDuration / s->totalIters , s->totalIters ) ;
+
+    histPrint( &s->iteration , "Iteration time (ms)" , 1000.0 ) ;
+    histPrint( &s->transit   , "Transit time (ms)"   , 1000.0 ) ;
+    histPrint( &s->jitter    , "Arrival jitter (ms)" , 1000.0 ) ;
+    if ( s->lost > 0 || s->reordered > 0 || s->duplicates > 0 )
+        printf("Sequence gaps          : %u report(s) missing , %u late , %u duplicated (ignored)\n"
+               , s->lost , s->reordered , s->duplicates ) ;
+
+    if ( s->unreported != 0 )
+        printf("Parts without a report : %lld , counted from the order summaries\n"
+               , s->unreported ) ;
+
+    if ( s->badReports > 0 )
+        printf("Ignored %u report(s) from unknown sub-factory IDs\n", s->badReports);
+}
+
+//------------------
+
+void statsFree( facStats *s )
+{
+    free( s->lastSent ) ;
+    s->lastSent  = NULL ;
+    s->iters     = NULL ;
+    s->partsMade = NULL ;
+    s->numFac    = 0 ;
+}
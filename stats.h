@@ -0,0 +1,81 @@
+//---------------------------------------------------------------------
+// Assignment : PA-04 Threads - UDP
+// Date       : 12/1/2025
+// Author     : Kyle Mirra      Akwasi Okyere
+// File Name  : stats.h
+//---------------------------------------------------------------------
+
+#ifndef  STATS_H
+#define  STATS_H
+
+/*--------------------------------------------------------------------
+   Latency histogram with log-linear buckets: values below 16 get a
+   bucket each, every power of two above is split into 16 sub-buckets,
+   so a percentile is off by at most 1/16 of its value. Units are up to
+   the user (microseconds here).
+----------------------------------------------------------------------*/
+#define HIST_SUB_BITS   4
+#define HIST_SUB        ( 1 << HIST_SUB_BITS )
+#define HIST_BUCKETS    ( ( 64 - HIST_SUB_BITS + 1 ) * HIST_SUB )
+
+typedef struct {
+    unsigned long long  count , sum , min , max ;
+    unsigned            bucket[ HIST_BUCKETS ] ;
+} latHist ;
+
+void                histInit      ( latHist *h ) ;
+void                histAdd       ( latHist *h , unsigned long long v ) ;
+void                histMerge     ( latHist *into , const latHist *from ) ;
+unsigned long long  histPercentile( const latHist *h , double pct ) ;
+void                histPrint     ( const latHist *h , const char *label , double scale ) ;
+
+/*--------------------------------------------------------------------
+   Per sub-factory production statistics kept by PROCUREMENT.
+
+   The store is sized at run time from the numFac reported in the
+   ORDR_CONFIRM message, so any number of sub-factories can be tracked.
+   Per-factory counters live in parallel arrays (struct-of-arrays),
+   all carved from one allocation, so the end-of-run table walks each
+   array sequentially. A production report touches one entry of each
+   array, not adjacent ones. The grand totals are maintained as reports
+   arrive rather than recomputed at the end.
+----------------------------------------------------------------------*/
+typedef struct {
+
+    unsigned   numFac ;         /* number of sub-factories tracked      */
+    unsigned  *iters ;          /* iterations completed, by facID-1     */
+    unsigned  *partsMade ;      /* parts made, by facID-1               */
+
+    /* Running totals, updated on every production report */
+    unsigned long long  totalParts ,
+                        totalIters ,
+                        totalDuration ;   /* sum of iteration times (ms) */
+    unsigned   minDuration ,              /* fastest iteration (ms)      */
+               maxDuration ;              /* slowest iteration (ms)      */
+    unsigned   badReports ;               /* reports with unknown facID  */
+    long long  unreported ;               /* parts in the order summaries
+                                             beyond those reported      */
+
+    /* Latency, from the send timestamps the factory puts in its reports */
+    unsigned long long *lastSent ;        /* send time (us) of the previous
+                                             report, by facID-1; owns the
+                                             allocation of all three     */
+    latHist    transit ,                  /* factory -> procurement (us) */
+               jitter ,                   /* inter-arrival jitter (us)   */
+               iteration ;                /* time between reports of the
+                                             same sub-factory (us)      */
+    unsigned   lost , reordered ,         /* sequence number gaps / late */
+               duplicates ;               /* reports received twice      */
+
+} facStats ;
+
+void  statsInit  ( facStats *s , unsigned numFac ) ;
+void  statsResize( facStats *s , unsigned numFac ) ;
+int   statsRecord( facStats *s , unsigned facID , unsigned parts , unsigned duration ) ;
+void  statsUnreported( facStats *s , long long parts ) ;
+int   statsTiming( facStats *s , unsigned facID , unsigned long long sentUs ,
+                   unsigned long long sinceUs ) ;
+void  statsPrint ( const facStats *s ) ;
+void  statsFree  ( facStats *s ) ;
+
+#endif
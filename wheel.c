@@ -0,0 +1,298 @@
+//---------------------------------------------------------------------
+// Assignment : PA-04 Threads - UDP
+// Date       : 12/1/2025
+// Author     : Kyle Mirra      Akwasi Okyere
+// File Name  : wheel.c
+//---------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+
+#include "wrappers.h"
+#include "wheel.h"
+
+/*--------------------------------------------------------------------
+   Milliseconds on the monotonic clock
+----------------------------------------------------------------------*/
+tick_t wheelClock( void )
+{
+    struct timespec ts ;
+    clock_gettime( CLOCK_MONOTONIC , &ts ) ;
+    return (tick_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000 ;
+}
+
+//------------------
+
+void wheelInit( timerWheel *w , tick_t now )
+{
+    memset( (void *) w , 0 , sizeof( *w ) ) ;
+    w->now = now ;
+}
+
+//------------------
+
+static void pushFront( wheelTimer **head , wheelTimer *t )
+{
+    t->next = *head ;
+    if ( t->next )
+        t->next->pprev = &t->next ;
+    t->pprev = head ;
+    *head    = t ;
+}
+
+//------------------
+
+static void unlink1( wheelTimer *t )
+{
+    *t->pprev = t->next ;
+    if ( t->next )
+        t->next->pprev = t->pprev ;
+    t->next  = NULL ;
+    t->pprev = NULL ;
+}
+
+/*--------------------------------------------------------------------
+   File 't' under the level whose slot width covers its distance from
+   the current tick. Timers already due go to the current level-0 slot.
+----------------------------------------------------------------------*/
+static void place( timerWheel *w , wheelTimer *t )
+{
+    tick_t  expires = t->expires ;
+    tick_t  delta ;
+    int     level ;
+
+    if ( expires < w->now )
+        expires = w->now ;
+    delta = expires - w->now ;
+
+    for ( level = 0 ; level < WHEEL_LEVELS - 1 ; level++ )
+        if ( delta < ( (tick_t) 1 << ( WHEEL_BITS * ( level + 1 ) ) ) )
+            break ;
+
+    if ( level == WHEEL_LEVELS - 1
+         && delta >= ( (tick_t) 1 << ( WHEEL_BITS * WHEEL_LEVELS ) ) )
+        expires = w->now + ( (tick_t) 1 << ( WHEEL_BITS * WHEEL_LEVELS ) ) - 1 ;
+
+    pushFront( &w->slot[ level ][ ( expires >> ( WHEEL_BITS * level ) ) & WHEEL_MASK ] , t ) ;
+    t->inWheel = 1 ;
+}
+
+//------------------
+
+void wheelAdd( timerWheel *w , wheelTimer *t , tick_t expires )
+{
+    t->expires = expires ;
+    place( w , t ) ;
+    w->count++ ;
+}
+
+//------------------
+
+void wheelDel( timerWheel *w , wheelTimer *t )
+{
+    if ( t->pprev == NULL || !t->inWheel )
+        return ;
+    unlink1( t ) ;
+    t->inWheel = 0 ;
+    w->count-- ;
+}
+
+/*--------------------------------------------------------------------
+   Re-file the timers of the current slot of 'level' one level down.
+   Returns that slot's index, so the caller knows whether the level
+   above has wrapped as well.
+----------------------------------------------------------------------*/
+static int cascade( timerWheel *w , int level )
+{
+    int          idx  = ( w->now >> ( WHEEL_BITS * level ) ) & WHEEL_MASK ;
+    wheelTimer  *list = w->slot[ level ][ idx ] ;
+
+    w->slot[ level ][ idx ] = NULL ;
+    while ( list ) {
+        wheelTimer *t = list ;
+        list     = t->next ;
+        t->next  = NULL ;
+        t->pprev = NULL ;
+        place( w , t ) ;
+    }
+    return idx ;
+}
+
+/*--------------------------------------------------------------------
+   Process every tick up to and including 'now'. Returns the timers
+   that expired, chained through 'next', oldest tick first.
+----------------------------------------------------------------------*/
+wheelTimer *wheelAdvance( timerWheel *w , tick_t now )
+{
+    wheelTimer  *expired = NULL , **tail = &expired ;
+
+    while ( w->now <= now )
+    {
+        int idx = w->now & WHEEL_MASK ;
+
+        if ( idx == 0 )
+            for ( int level = 1 ; level < WHEEL_LEVELS ; level++ )
+                if ( cascade( w , level ) != 0 )
+                    break ;
+
+        wheelTimer *list = w->slot[ 0 ][ idx ] ;
+        w->slot[ 0 ][ idx ] = NULL ;
+        while ( list ) {
+            wheelTimer *t = list ;
+            list       = t->next ;
+            t->next    = NULL ;
+            t->pprev   = NULL ;
+            t->inWheel = 0 ;
+            w->count-- ;
+            *tail = t ;
+            tail  = &t->next ;
+        }
+        w->now++ ;
+    }
+    return expired ;
+}
+
+/*--------------------------------------------------------------------
+   How many ms until wheelAdvance() may have something to return:
+   the next busy level-0 slot, or the next cascade. -1 if the wheel
+   is empty.
+----------------------------------------------------------------------*/
+long wheelTimeout( timerWheel *w )
+{
+    if ( w->count == 0 )
+        return -1 ;
+
+    int start = w->now & WHEEL_MASK ;
+    for ( int i = 0 ; i < WHEEL_SIZE - start ; i++ )
+        if ( w->slot[ 0 ][ start + i ] )
+            return i ;
+
+    return WHEEL_SIZE - start ;
+}
+
+/*--------------------------------------------------------------------
+   Worker: advance the wheel to the current time and run whatever has
+   expired, one timer at a time, with the lock released
+----------------------------------------------------------------------*/
+static void *schedWorker( void *arg )
+{
+    wheelSched *s = arg ;
+
+    pthread_mutex_lock( &s->lock ) ;
+    while ( 1 )
+    {
+        if ( s->ready ) {
+            wheelTimer *t = s->ready ;
+            unlink1( t ) ;
+            if ( s->ready == NULL )
+                s->readyTail = &s->ready ;
+            pthread_mutex_unlock( &s->lock ) ;
+
+            t->fire( t ) ;
+
+            pthread_mutex_lock( &s->lock ) ;
+            continue ;
+        }
+
+        wheelTimer *list = wheelAdvance( &s->wheel , wheelClock() ) ;
+        while ( list ) {
+            wheelTimer *t = list ;
+            list = t->next ;
+            t->next  = NULL ;
+            t->pprev = s->readyTail ;
+            *s->readyTail = t ;
+            s->readyTail  = &t->next ;
+        }
+        if ( s->ready ) {
+            pthread_cond_signal( &s->cond ) ;   // more than one may be due
+            continue ;
+        }
+
+        long wait = wheelTimeout( &s->wheel ) ;
+        if ( wait < 0 )
+            pthread_cond_wait( &s->cond , &s->lock ) ;
+        else {
+            struct timespec until ;
+            clock_gettime( CLOCK_MONOTONIC , &until ) ;
+            until.tv_nsec += ( wait ? wait : 1 ) * 1000000L ;
+            until.tv_sec  += until.tv_nsec / 1000000000L ;
+            until.tv_nsec %= 1000000000L ;
+            pthread_cond_timedwait( &s->cond , &s->lock , &until ) ;
+        }
+    }
+    return NULL ;
+}
+
+//------------------
+
+void schedStart( wheelSched *s , int numWorkers )
+{
+    pthread_condattr_t attr ;
+
+    memset( (void *) s , 0 , sizeof( *s ) ) ;
+    wheelInit( &s->wheel , wheelClock() ) ;
+    s->readyTail  = &s->ready ;
+    s->numWorkers = numWorkers ;
+
+    pthread_mutex_init( &s->lock , NULL ) ;
+    pthread_condattr_init( &attr ) ;
+    pthread_condattr_setclock( &attr , CLOCK_MONOTONIC ) ;
+    pthread_cond_init( &s->cond , &attr ) ;
+    pthread_condattr_destroy( &attr ) ;
+
+    s->workers = calloc( numWorkers , sizeof( pthread_t ) ) ;
+    if ( s->workers == NULL )
+        err_sys( "Failed to allocate the timer wheel workers" ) ;
+
+    for ( int i = 0 ; i < numWorkers ; i++ )
+        Pthread_create( &s->workers[i] , NULL , schedWorker , s ) ;
+}
+
+/*--------------------------------------------------------------------
+   Run t->fire(t) on a worker 'delayMS' milliseconds from now
+----------------------------------------------------------------------*/
+void schedAfter( wheelSched *s , wheelTimer *t , long delayMS )
+{
+    pthread_mutex_lock( &s->lock ) ;
+    wheelAdd( &s->wheel , t , wheelClock() + ( delayMS > 0 ? delayMS : 0 ) ) ;
+    pthread_cond_signal( &s->cond ) ;
+    pthread_mutex_unlock( &s->lock ) ;
+}
+
+/*--------------------------------------------------------------------
+   Make sure 't' does not fire, whether it is still on the wheel or
+   already expired and waiting for a worker. A fire() that is already
+   running is not affected.
+----------------------------------------------------------------------*/
+void schedCancel( wheelSched *s , wheelTimer *t )
+{
+    pthread_mutex_lock( &s->lock ) ;
+    if ( t->pprev ) {
+        if ( t->inWheel )
+            wheelDel( &s->wheel , t ) ;
+        else {
+            if ( s->readyTail == &t->next )
+                s->readyTail = t->pprev ;
+            unlink1( t ) ;
+        }
+    }
+    pthread_mutex_unlock( &s->lock ) ;
+}
+
+/*--------------------------------------------------------------------
+   Fire 't' now if it is waiting on the wheel. A timer that is not
+   scheduled, already expired, or running is left alone.
+----------------------------------------------------------------------*/
+void schedExpedite( wheelSched *s , wheelTimer *t )
+{
+    pthread_mutex_lock( &s->lock ) ;
+    if ( t->pprev && t->inWheel ) {
+        wheelDel( &s->wheel , t ) ;
+        wheelAdd( &s->wheel , t , s->wheel.now ) ;
+        pthread_cond_signal( &s->cond ) ;
+    }
+    pthread_mutex_unlock( &s->lock ) ;
+}
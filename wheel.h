@@ -0,0 +1,71 @@
+//---------------------------------------------------------------------
+// Assignment : PA-04 Threads - UDP
+// Date       : 12/1/2025
+// Author     : Kyle Mirra      Akwasi Okyere
+// File Name  : wheel.h
+//---------------------------------------------------------------------
+
+#ifndef  WHEEL_H
+#define  WHEEL_H
+
+#include <pthread.h>
+
+/*--------------------------------------------------------------------
+   Hierarchical timer wheel with a 1 ms tick.
+
+   Level 0 has one slot per tick; every higher level has slots that are
+   WHEEL_SIZE times coarser, and its timers are cascaded down a level
+   when the level below wraps around. Adding, removing and expiring a
+   timer are O(1); the 4 levels reach about 4.6 hours ahead.
+
+   A timerWheel by itself is not thread-safe. wheelSched wraps one with
+   a lock and a few worker threads that run the fire() callbacks of the
+   expired timers.
+----------------------------------------------------------------------*/
+#define WHEEL_BITS      6
+#define WHEEL_SIZE      ( 1 << WHEEL_BITS )
+#define WHEEL_MASK      ( WHEEL_SIZE - 1 )
+#define WHEEL_LEVELS    4
+
+typedef unsigned long long  tick_t ;     // milliseconds
+
+typedef struct wheelTimer {
+    struct wheelTimer   *next ,
+                       **pprev ;         // NULL when neither scheduled nor ready
+    int                  inWheel ;       // on a wheel slot (else on a ready list)
+    tick_t               expires ;
+    void               (*fire)( struct wheelTimer *t ) ;
+} wheelTimer ;
+
+typedef struct {
+    tick_t       now ;                   // next tick to be processed
+    unsigned     count ;                 // timers scheduled
+    wheelTimer  *slot[ WHEEL_LEVELS ][ WHEEL_SIZE ] ;
+} timerWheel ;
+
+void        wheelInit   ( timerWheel *w , tick_t now ) ;
+void        wheelAdd    ( timerWheel *w , wheelTimer *t , tick_t expires ) ;
+void        wheelDel    ( timerWheel *w , wheelTimer *t ) ;
+wheelTimer *wheelAdvance( timerWheel *w , tick_t now ) ;
+long        wheelTimeout( timerWheel *w ) ;
+tick_t      wheelClock  ( void ) ;
+
+/*--------------------------------------------------------------------
+   A timer wheel driven by 'numWorkers' threads
+----------------------------------------------------------------------*/
+typedef struct {
+    timerWheel       wheel ;
+    pthread_mutex_t  lock ;
+    pthread_cond_t   cond ;
+    wheelTimer      *ready ,             // expired, waiting for a worker
+                   **readyTail ;
+    int              numWorkers ;
+    pthread_t       *workers ;
+} wheelSched ;
+
+void  schedStart( wheelSched *s , int numWorkers ) ;
+void  schedAfter( wheelSched *s , wheelTimer *t , long delayMS ) ;
+void  schedCancel( wheelSched *s , wheelTimer *t ) ;
+void  schedExpedite( wheelSched *s , wheelTimer *t ) ;
+
+#endif